@@ -1,25 +1,48 @@
 // bin-to-nviz - a program that converts arbitrary binary files to .nviz visual files
 // made by Nikola Whallon (https://github.com/nikolawhallon/nviz-project, nikola.whallon@gmail.com)
 
+#define _FILE_OFFSET_BITS 64
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+
+#include "nviz.h"
 
 #define MAX_COL 200
 #define MAX_ROW 100
-#define CH_BYTS 2
 
 int main(int argc, char * argv[])
 {
+	// command line options
+	int version = NVIZ_VERSION_RAW;
+	int opt;
+	while ((opt = getopt(argc, argv, "z")) != -1)
+	{
+		switch (opt)
+		{
+			case 'z':
+				version = NVIZ_VERSION_DELTA;
+				break;
+			default:
+				argc = 0;
+				break;
+		}
+	}
+
 	// check for the right number of arguments
-	if (argc != 7)
+	if (argc - optind != 6)
 	{
 		fprintf(stderr, "ERROR - wrong number of arguments\n");
-		fprintf(stderr, "usage: %s in_file_path out_file_path columns rows frames_per_second seconds\n", argv[0]);
+		fprintf(stderr, "usage: %s [-z] in_file_path out_file_path columns rows frames_per_second seconds\n", argv[0]);
 		return 1;
 	}
 
+	argv += optind - 1;
+
 	// make the bin file path
 	char bin_file_path[256];
 	sprintf(bin_file_path, argv[1]);
@@ -32,7 +55,14 @@ int main(int argc, char * argv[])
 	uint8_t col = atoi(argv[3]);
 	uint8_t row = atoi(argv[4]);
 	uint8_t fps = atoi(argv[5]);
-	uint16_t sec = atoi(argv[6]);
+	int64_t sec = strtoll(argv[6], NULL, 10);
+
+	// check that a frame fits the frame buffer
+	if (col == 0 || row == 0 || col > MAX_COL || row > MAX_ROW || fps == 0 || sec <= 0)
+	{
+		fprintf(stderr, "ERROR - columns and rows must be from 1 to %d and %d, frames_per_second and seconds must be at least 1\n", MAX_COL, MAX_ROW);
+		return 1;
+	}
 
 	// declare and open the bin_file
 	FILE * bin_file = fopen(bin_file_path, "rb");
@@ -45,44 +75,70 @@ int main(int argc, char * argv[])
 	}
 
 	// calculate the file size
-	fseek(bin_file, 0, SEEK_END);
-	uint32_t file_size = ftell(bin_file);
-	fseek(bin_file, 0, SEEK_SET);
+	fseeko(bin_file, 0, SEEK_END);
+	off_t file_size = ftello(bin_file);
+	fseeko(bin_file, 0, SEEK_SET);
 
 	// a buffer for a frame
+	size_t frame_bytes = CH_BYTS * (col * row);
 	char frame[CH_BYTS * (MAX_COL * MAX_ROW)];
 	memset(frame, 48, CH_BYTS * (MAX_COL * MAX_ROW));
 
-	// declare and open nviz_file
-	FILE * nviz_file = fopen(nviz_file_path, "wb");
+	// the frame count is known up front, the file may not be big enough for all of the seconds asked for
+	int64_t fno = fps * sec;
 
-	// write out the video info
-	fwrite(&col, 1, 1, nviz_file);
-	fwrite(&row, 1, 1, nviz_file);
-	fwrite(&fps, 1, 1, nviz_file);
-	fwrite(&sec, 2, 1, nviz_file);
+	if (fno > file_size / (off_t) frame_bytes)
+	{
+		fno = file_size / frame_bytes;
+
+		printf("the binary file was not big enough to create a %lld second long nviz file\n", (long long) sec);
+		printf("truncating at %f seconds\n", (double) fno / fps);
+	}
+
+	// open the nviz file and write out the video info
+	nviz_writer nviz;
+
+	if (nviz_create(&nviz, nviz_file_path, version, col, row, fps, fno, NVIZ_WRITE_BUFFER))
+	{
+		fprintf(stderr, "ERROR - could not open %s\n", nviz_file_path);
+		fclose(bin_file);
+		return 1;
+	}
 
 	// let user know data writing has begun
 	printf("wrting data...\n");
 	printf("\n");
 
-	int i;
-	for (i = 0; i < fps * sec; i++)
+	// a short read or a failed write stops the conversion, the file is still finished so its fd is closed
+	int failed = 0;
+
+	int64_t f;
+	for (f = 0; f < fno && !failed; f++)
 	{
-		if (fread(frame, CH_BYTS * (MAX_COL * MAX_ROW), 1, bin_file) != EOF)
+		if (fread(frame, frame_bytes, 1, bin_file) != 1)
 		{
-			fwrite(frame, CH_BYTS * (MAX_COL * MAX_ROW), 1, nviz_file);
+			fprintf(stderr, "ERROR - could not read %s\n", bin_file_path);
+			failed = 1;
 		}
-		else
+		else if (nviz_write_frame(&nviz, frame))
 		{
-			printf("the binary file was not big enough to create a %d second long nviz file\n", sec);
-			printf("truncating at %f seconds\n", (float) i / (float) sec);
-			break;
+			fprintf(stderr, "ERROR - could not write %s\n", nviz_file_path);
+			failed = 1;
 		}
 	}
 
 	// close nviz_file
-	fclose(nviz_file);
+	if (nviz_finish(&nviz) && !failed)
+	{
+		fprintf(stderr, "ERROR - could not write %s\n", nviz_file_path);
+		failed = 1;
+	}
+
+	if (failed)
+	{
+		fclose(bin_file);
+		return 1;
+	}
 
 	// close bin_file
 	fclose(bin_file);
@@ -93,7 +149,7 @@ int main(int argc, char * argv[])
 	printf("col\t\t\t\t%d\n", col);
 	printf("row\t\t\t\t%d\n", row);
 	printf("fps\t\t\t\t%d\n", fps);
-	printf("fno\t\t\t\t%d\n", i);
+	printf("fno\t\t\t\t%lld\n", (long long) fno);
 	printf("\n");
 
 	return 0;
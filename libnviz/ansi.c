@@ -0,0 +1,255 @@
+// libnviz ansi - a terminal backend for the nviz viewers that builds a whole frame of escape sequences in one buffer
+// made by Nikola Whallon (https://github.com/nikolawhallon/nviz-project, nikola.whallon@gmail.com)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+
+#include "ansi.h"
+
+//----------------------------------------------------				// GLOBAL VARIABLES
+
+int g_ansi_col, g_ansi_row;
+int g_ansi_headless;
+int64_t g_ansi_bytes;
+
+// a whole frame is built in g_ansi_buf and written at once
+struct termios g_ansi_saved_termios;
+char * g_ansi_buf;
+size_t g_ansi_buf_size;
+size_t g_ansi_buf_len;
+int g_ansi_cur_r;				// where the terminal cursor is, -1 if unknown
+int g_ansi_cur_c;
+int g_ansi_cur_clr;				// the color pair in effect, -1 if unknown
+size_t g_ansi_color_len[8];
+const char * g_ansi_color[8] =			// the color pairs the viewers give ncurses, 0 is the terminal default
+{
+	"\x1b[39;49m",
+	"\x1b[34;40m",
+	"\x1b[32;40m",
+	"\x1b[36;40m",
+	"\x1b[31;40m",
+	"\x1b[35;40m",
+	"\x1b[33;40m",
+	"\x1b[37;40m"
+};
+
+//----------------------------------------------------				// DRAWING
+
+// write out everything in the ansi buffer
+void ansi_flush()
+{
+	size_t done = 0;
+
+	g_ansi_bytes += g_ansi_buf_len;
+
+	if (g_ansi_headless)
+	{
+		g_ansi_buf_len = 0;
+
+		return;
+	}
+
+	while (done < g_ansi_buf_len)
+	{
+		ssize_t n = write(STDOUT_FILENO, g_ansi_buf + done, g_ansi_buf_len - done);
+
+		if (n < 0 && errno == EINTR)
+		{
+			continue;
+		}
+
+		if (n <= 0)
+		{
+			break;
+		}
+
+		done += n;
+	}
+
+	g_ansi_buf_len = 0;
+}
+
+// append bytes to the ansi buffer, it is only flushed early if a frame does not fit
+void ansi_put(const char * bytes, size_t len)
+{
+	if (g_ansi_buf_len + len > g_ansi_buf_size)
+	{
+		ansi_flush();
+	}
+
+	memcpy(g_ansi_buf + g_ansi_buf_len, bytes, len);
+	g_ansi_buf_len += len;
+}
+
+// move the cursor, forward within a row is cheaper than an absolute jump
+void ansi_move(int r, int c)
+{
+	char seq[32];
+	int len;
+
+	if (r == g_ansi_cur_r && c == g_ansi_cur_c)
+	{
+		return;
+	}
+
+	if (r == g_ansi_cur_r && c > g_ansi_cur_c)
+	{
+		len = sprintf(seq, "\x1b[%dC", c - g_ansi_cur_c);
+	}
+	else
+	{
+		len = sprintf(seq, "\x1b[%d;%dH", r + 1, c + 1);
+	}
+
+	ansi_put(seq, len);
+
+	g_ansi_cur_r = r;
+	g_ansi_cur_c = c;
+}
+
+// draw characters at r, c in a color pair, clipped to the terminal
+void ansi_text(int r, int c, const char * chrs, int len, char clr)
+{
+	int max_len = g_ansi_col - c;
+
+	// writing the bottom right cell would scroll the terminal
+	if (r == g_ansi_row - 1)
+	{
+		max_len--;
+	}
+
+	if (r < 0 || r >= g_ansi_row || c < 0 || max_len <= 0)
+	{
+		return;
+	}
+
+	if (len > max_len)
+	{
+		len = max_len;
+	}
+
+	ansi_move(r, c);
+
+	int pair = (clr >= 1 && clr <= 7) ? clr : 0;
+
+	if (pair != g_ansi_cur_clr)
+	{
+		ansi_put(g_ansi_color[pair], g_ansi_color_len[pair]);
+		g_ansi_cur_clr = pair;
+	}
+
+	ansi_put(chrs, len);
+
+	g_ansi_cur_c += len;
+}
+
+// clear the terminal
+void ansi_clear()
+{
+	ansi_put("\x1b[0m\x1b[2J", 8);
+
+	g_ansi_cur_r = -1;
+	g_ansi_cur_c = -1;
+	g_ansi_cur_clr = -1;
+}
+
+// put the terminal back the way it was, also used on SIGINT and SIGTERM
+void ansi_restore_terminal()
+{
+	const char * seq = "\x1b[0m\x1b[2J\x1b[?25h\x1b[?1049l";
+
+	write(STDOUT_FILENO, seq, strlen(seq));
+
+	tcsetattr(STDIN_FILENO, TCSANOW, &g_ansi_saved_termios);
+}
+
+// signal handler
+void ansi_signal(int sig)
+{
+	ansi_restore_terminal();
+
+	_exit(128 + sig);
+}
+
+//----------------------------------------------------				// SETUP
+
+// initialize the ansi frame buffer for a col x row terminal, on its own it is all a headless viewer needs
+void ansi_init_buffer(int col, int row)
+{
+	g_ansi_col = col;
+	g_ansi_row = row;
+
+	int i;
+	for (i = 0; i < 8; i++)
+	{
+		g_ansi_color_len[i] = strlen(g_ansi_color[i]);
+	}
+
+	// room for a cursor jump and a color change on every cell
+	g_ansi_buf_size = (size_t) col * row * 24 + 4096;
+	g_ansi_buf = malloc(g_ansi_buf_size);
+	g_ansi_buf_len = 0;
+
+	g_ansi_cur_r = -1;
+	g_ansi_cur_c = -1;
+	g_ansi_cur_clr = -1;
+}
+
+// deinitialize the ansi frame buffer
+void ansi_deinit_buffer()
+{
+	free(g_ansi_buf);
+
+	g_ansi_buf = NULL;
+}
+
+// initialize the ansi backend on the terminal, g_ansi_col x g_ansi_row is its size
+// keys are read one byte at a time, a read waits for one if wait_for_keys is set and returns nothing otherwise
+void ansi_init(int wait_for_keys)
+{
+	struct termios raw;
+
+	tcgetattr(STDIN_FILENO, &g_ansi_saved_termios);
+
+	raw = g_ansi_saved_termios;
+	raw.c_lflag &= ~(ICANON | ECHO);
+	raw.c_cc[VMIN] = wait_for_keys ? 1 : 0;
+	raw.c_cc[VTIME] = 0;
+
+	tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+
+	signal(SIGINT, ansi_signal);
+	signal(SIGTERM, ansi_signal);
+
+	// get the col x row of the terminal
+	struct winsize ws;
+
+	if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_col > 0 && ws.ws_row > 0)
+	{
+		ansi_init_buffer(ws.ws_col, ws.ws_row);
+	}
+	else
+	{
+		ansi_init_buffer(80, 24);
+	}
+
+	// alternate screen, no cursor
+	ansi_put("\x1b[?1049h\x1b[?25l", 14);
+	ansi_clear();
+	ansi_flush();
+}
+
+// deinitialize the ansi backend
+void ansi_deinit()
+{
+	ansi_flush();
+	ansi_restore_terminal();
+	ansi_deinit_buffer();
+}
@@ -0,0 +1,28 @@
+// libnviz ansi - a terminal backend for the nviz viewers that builds a whole frame of escape sequences in one buffer
+// made by Nikola Whallon (https://github.com/nikolawhallon/nviz-project, nikola.whallon@gmail.com)
+
+#ifndef ANSI_H
+#define ANSI_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+extern int g_ansi_col, g_ansi_row;		// the terminal, or the frame buffer when headless
+extern int g_ansi_headless;			// bool, frames are built and thrown away, nothing is written
+extern int64_t g_ansi_bytes;			// bytes written to the terminal, or that would have been when headless
+
+// setup
+void ansi_init(int wait_for_keys);
+void ansi_deinit();
+void ansi_init_buffer(int col, int row);
+void ansi_deinit_buffer();
+
+// drawing
+void ansi_flush();
+void ansi_put(const char * bytes, size_t len);
+void ansi_move(int r, int c);
+void ansi_text(int r, int c, const char * chrs, int len, char clr);
+void ansi_clear();
+void ansi_restore_terminal();
+
+#endif
@@ -0,0 +1,1676 @@
+// libnviz - reads and writes the .nviz video/visual files and .nframe ascii art files of every nviz tool
+// made by Nikola Whallon (https://github.com/nikolawhallon/nviz-project, nikola.whallon@gmail.com)
+
+#define _FILE_OFFSET_BITS 64
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include "nviz.h"
+
+//----------------------------------------------------				// HEADERS
+
+// how many bytes the header that starts with these NVIZ_HD bytes has
+// a legacy file never has 0 columns, so a 0 there starts the versioned header
+size_t nviz_header_size(const unsigned char * header)
+{
+	return header[0] == 0 && memcmp(header + 1, "NVZ", 3) == 0 ? NVIZ_HD_V1 : NVIZ_HD;
+}
+
+// parse a legacy or versioned header, returns 1 if it is not a header this library can read
+int nviz_parse_header(const unsigned char * header, nviz_header * h)
+{
+	if (nviz_header_size(header) == NVIZ_HD_V1)
+	{
+		h->h_version = header[4];
+		h->h_col = header[5];
+		h->h_row = header[6];
+		h->h_fps = header[7];
+		h->h_frames = 0;
+
+		int i;
+		for (i = 7; i >= 0; i--)
+		{
+			h->h_frames = h->h_frames << 8 | header[8 + i];
+		}
+
+		h->h_data_offset = NVIZ_HD_V1;
+
+		if (h->h_version == 0)
+		{
+			return 1;
+		}
+	}
+	else
+	{
+		h->h_version = 0;
+		h->h_col = header[0];
+		h->h_row = header[1];
+		h->h_fps = header[2];
+		h->h_frames = (int64_t) h->h_fps * (header[3] | (header[4] << 8));
+		h->h_data_offset = NVIZ_HD;
+	}
+
+	h->h_frame_bytes = (size_t) CH_BYTS * h->h_col * h->h_row;
+
+	if (h->h_version > NVIZ_VERSION || h->h_col == 0 || h->h_row == 0 || h->h_fps == 0 || h->h_frames < 0)
+	{
+		return 1;
+	}
+
+	return 0;
+}
+
+// fill in a versioned header, the frame count is 64 bit little endian and 0 when it is not known yet
+void nviz_make_header(unsigned char * header, int version, int col, int row, int fps, int64_t frames)
+{
+	header[0] = 0;
+	memcpy(header + 1, "NVZ", 3);
+	header[4] = version;
+	header[5] = col;
+	header[6] = row;
+	header[7] = fps;
+
+	int i;
+	for (i = 0; i < 8; i++)
+	{
+		header[8 + i] = (uint64_t) frames >> (8 * i);
+	}
+}
+
+// offset of a frame in the file
+off_t nviz_frame_offset(const nviz_header * h, int64_t frame_index)
+{
+	return h->h_data_offset + (off_t) h->h_frame_bytes * frame_index;
+}
+
+//----------------------------------------------------				// LOW LEVEL IO
+
+// write len bytes at the current position, for outputs that cannot seek
+int nviz_write_all(int fd, const char * buf, size_t len)
+{
+	size_t done = 0;
+
+	while (done < len)
+	{
+		ssize_t n = write(fd, buf + done, len - done);
+
+		if (n < 0 && errno == EINTR)
+		{
+			continue;
+		}
+
+		if (n <= 0)
+		{
+			return 1;
+		}
+
+		done += n;
+	}
+
+	return 0;
+}
+
+// write len bytes at offset off, threads can write different parts of one file at once
+int nviz_write_at(int fd, const char * buf, size_t len, off_t off)
+{
+	size_t done = 0;
+
+	while (done < len)
+	{
+		ssize_t n = pwrite(fd, buf + done, len - done, off + done);
+
+		if (n < 0 && errno == EINTR)
+		{
+			continue;
+		}
+
+		if (n <= 0)
+		{
+			return 1;
+		}
+
+		done += n;
+	}
+
+	return 0;
+}
+
+//----------------------------------------------------				// DELTA CODING
+
+// a version 2 file is a run of records after the header, a type byte, a 32 bit little endian payload length and the payload
+//
+//   'K' keyframe	the cells of the frame, coded as below
+//   'D' delta		a signed byte, the rows the frame before scrolled up by (down when negative), then the cells coded against it
+//			the rows that scroll in are blank, and cells past the last op are the same as in the shifted frame before
+//   'I' index		after the last frame, the frame index and offset of every keyframe, 64 bit little endian pairs
+//
+// cells are coded as ops, a varint of count << 2 | op
+//
+//   skip		count cells are the same as in the shifted frame before, only in a delta
+//   literal		count cells follow
+//   fill		one cell follows, repeated count times
+//
+// a file that was written to the end has a footer after the index, its 64 bit offset and "NVZI"
+// a keyframe comes every second, so seeking decodes at most a second of deltas
+
+#define RECORD_HD 5
+#define RECORD_KEY 'K'
+#define RECORD_DELTA 'D'
+#define RECORD_INDEX 'I'
+#define FOOTER_SIZE 12
+#define OP_SKIP 0
+#define OP_LITERAL 1
+#define OP_FILL 2
+#define DELTA_MAX_PAYLOAD(cells) (3 * (size_t) (cells) + 16)	// no op codes to more than 3 bytes a cell
+
+static const char g_blank_cell[CH_BYTS] = { 0, ' ' };
+
+static void put_le(unsigned char * bytes, uint64_t value, int len)
+{
+	int i;
+	for (i = 0; i < len; i++)
+	{
+		bytes[i] = value >> (8 * i);
+	}
+}
+
+static uint64_t get_le(const unsigned char * bytes, int len)
+{
+	uint64_t value = 0;
+
+	int i;
+	for (i = len - 1; i >= 0; i--)
+	{
+		value = value << 8 | bytes[i];
+	}
+
+	return value;
+}
+
+static size_t put_varint(unsigned char * bytes, uint64_t value)
+{
+	size_t len = 0;
+
+	while (value >= 0x80)
+	{
+		bytes[len++] = (value & 0x7f) | 0x80;
+		value >>= 7;
+	}
+
+	bytes[len++] = value;
+
+	return len;
+}
+
+// returns 1 if the varint runs past len
+static int get_varint(const unsigned char * bytes, size_t len, size_t * pos, uint64_t * value)
+{
+	int shift;
+
+	*value = 0;
+
+	for (shift = 0; *pos < len && shift < 64; shift += 7)
+	{
+		unsigned char byte = bytes[(*pos)++];
+
+		*value |= (uint64_t) (byte & 0x7f) << shift;
+
+		if (byte < 0x80)
+		{
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+// scroll the rows of a frame up by shift rows, down when it is negative, the rows that come in are blank
+static void shift_rows(char * cells, int col, int row, int shift)
+{
+	size_t row_bytes = (size_t) CH_BYTS * col;
+	int blank_first;
+	int blank_rows = shift < 0 ? -shift : shift;
+
+	if (shift == 0)
+	{
+		return;
+	}
+
+	if (shift > 0)
+	{
+		memmove(cells, cells + shift * row_bytes, (row - shift) * row_bytes);
+		blank_first = row - shift;
+	}
+	else
+	{
+		memmove(cells + blank_rows * row_bytes, cells, (row - blank_rows) * row_bytes);
+		blank_first = 0;
+	}
+
+	int i;
+	for (i = blank_first * col; i < (blank_first + blank_rows) * col; i++)
+	{
+		memcpy(cells + CH_BYTS * i, g_blank_cell, CH_BYTS);
+	}
+}
+
+// how many cells of a frame match the frame before shifted by shift rows
+static int64_t shift_matches(const char * frame, const char * prev, int col, int row, int shift)
+{
+	size_t row_bytes = (size_t) CH_BYTS * col;
+	int64_t matches = 0;
+
+	int r;
+	int c;
+	for (r = 0; r < row; r++)
+	{
+		const char * cells = frame + r * row_bytes;
+		int from = r + shift;
+
+		for (c = 0; c < col; c++)
+		{
+			const char * ref = from >= 0 && from < row ? prev + from * row_bytes + CH_BYTS * c : g_blank_cell;
+
+			matches += memcmp(cells + CH_BYTS * c, ref, CH_BYTS) == 0;
+		}
+	}
+
+	return matches;
+}
+
+#define SAME_CELL(a, i, b, j) (memcmp((a) + CH_BYTS * (i), (b) + CH_BYTS * (j), CH_BYTS) == 0)
+
+// code n cells as ops against ref, a NULL ref codes a keyframe, returns the bytes coded
+// skips that would run to the end are left out
+static size_t code_cells(unsigned char * out, const char * cells, const char * ref, int n)
+{
+	size_t len = 0;
+	int i = 0;
+
+	while (i < n)
+	{
+		int j = i;
+
+		if (ref != NULL)
+		{
+			while (j < n && SAME_CELL(cells, j, ref, j))
+			{
+				j++;
+			}
+
+			if (j == n)
+			{
+				break;
+			}
+
+			if (j > i)
+			{
+				len += put_varint(out + len, (uint64_t) (j - i) << 2 | OP_SKIP);
+				i = j;
+				continue;
+			}
+		}
+
+		// three or more of the same cell are filled
+		while (j < n && SAME_CELL(cells, j, cells, i))
+		{
+			j++;
+		}
+
+		if (j - i >= 3)
+		{
+			len += put_varint(out + len, (uint64_t) (j - i) << 2 | OP_FILL);
+			memcpy(out + len, cells + CH_BYTS * i, CH_BYTS);
+			len += CH_BYTS;
+			i = j;
+			continue;
+		}
+
+		// a literal runs up to the next skip or fill
+		j = i + 1;
+
+		while (j < n && !(ref != NULL && SAME_CELL(cells, j, ref, j)) && !(j + 2 < n && SAME_CELL(cells, j, cells, j + 1) && SAME_CELL(cells, j, cells, j + 2)))
+		{
+			j++;
+		}
+
+		len += put_varint(out + len, (uint64_t) (j - i) << 2 | OP_LITERAL);
+		memcpy(out + len, cells + CH_BYTS * i, CH_BYTS * (j - i));
+		len += CH_BYTS * (j - i);
+		i = j;
+	}
+
+	return len;
+}
+
+// decode ops into n cells that already hold the shifted frame before, returns 1 if the ops are corrupt
+// a keyframe cannot skip and has to cover every cell
+static int decode_cells(char * cells, int n, const unsigned char * ops, size_t len, int key)
+{
+	size_t pos = 0;
+	int i = 0;
+
+	while (pos < len)
+	{
+		uint64_t op;
+
+		if (get_varint(ops, len, &pos, &op))
+		{
+			return 1;
+		}
+
+		uint64_t count = op >> 2;
+
+		if (count == 0 || count > (uint64_t) (n - i))
+		{
+			return 1;
+		}
+
+		switch (op & 3)
+		{
+			case OP_SKIP:
+				if (key)
+				{
+					return 1;
+				}
+				break;
+			case OP_LITERAL:
+				if (len - pos < CH_BYTS * count)
+				{
+					return 1;
+				}
+				memcpy(cells + CH_BYTS * i, ops + pos, CH_BYTS * count);
+				pos += CH_BYTS * count;
+				break;
+			case OP_FILL:
+				if (len - pos < CH_BYTS)
+				{
+					return 1;
+				}
+				uint64_t k;
+				for (k = 0; k < count; k++)
+				{
+					memcpy(cells + CH_BYTS * (i + k), ops + pos, CH_BYTS);
+				}
+				pos += CH_BYTS;
+				break;
+			default:
+				return 1;
+		}
+
+		i += count;
+	}
+
+	return key && i != n;
+}
+
+//----------------------------------------------------				// READER
+
+// wait for a pipe to have something to read, returns 1 if r_cancel_fd became readable instead
+// a pipe can go quiet for as long as its writer likes, even in the middle of a frame
+static int wait_stream(nviz_reader * r)
+{
+	if (r->r_cancel_fd < 0)
+	{
+		return 0;
+	}
+
+	struct pollfd fds[2];
+
+	fds[0].fd = r->r_fd;
+	fds[0].events = POLLIN;
+	fds[1].fd = r->r_cancel_fd;
+	fds[1].events = POLLIN;
+
+	while (poll(fds, 2, -1) < 0)
+	{
+		// anything but a signal is left to the read to report
+		if (errno != EINTR)
+		{
+			return 0;
+		}
+	}
+
+	return (fds[1].revents & POLLIN) != 0;
+}
+
+// read len bytes at offset off, falling back to sequential reads for pipes, returns 1 if they could not be read
+int nviz_read_at(nviz_reader * r, char * buf, size_t len, off_t off)
+{
+	size_t done = 0;
+
+	while (done < len)
+	{
+		ssize_t n = pread(r->r_fd, buf + done, len - done, off + done);
+
+		if (n < 0 && errno == ESPIPE)
+		{
+			// a pipe can only move forward, so skip up to off and read from there
+			while (r->r_stream_pos < off + (off_t) done)
+			{
+				char skip[4096];
+				size_t want = off + done - r->r_stream_pos;
+
+				if (wait_stream(r))
+				{
+					return 1;
+				}
+
+				n = read(r->r_fd, skip, want < sizeof(skip) ? want : sizeof(skip));
+
+				if (n <= 0)
+				{
+					return 1;
+				}
+
+				r->r_stream_pos += n;
+			}
+
+			if (r->r_stream_pos != off + (off_t) done || wait_stream(r))
+			{
+				return 1;
+			}
+
+			n = read(r->r_fd, buf + done, len - done);
+
+			if (n > 0)
+			{
+				r->r_stream_pos += n;
+			}
+		}
+
+		if (n < 0 && errno == EINTR)
+		{
+			continue;
+		}
+
+		if (n <= 0)
+		{
+			return 1;
+		}
+
+		done += n;
+	}
+
+	return 0;
+}
+
+// read the type and payload length of the record at off, returns 1 if there is none
+static int record_header(nviz_reader * r, off_t off, int * type, size_t * len)
+{
+	unsigned char header[RECORD_HD];
+
+	if (r->r_map != NULL)
+	{
+		if (off < 0 || (uint64_t) off + RECORD_HD > r->r_map_size)
+		{
+			return 1;
+		}
+
+		memcpy(header, r->r_map + off, RECORD_HD);
+	}
+	else if (nviz_read_at(r, (char *) header, RECORD_HD, off))
+	{
+		return 1;
+	}
+
+	*type = header[0];
+	*len = get_le(header + 1, 4);
+
+	return 0;
+}
+
+// decode the record at r_next_offset into r_frame, returns 1 if it is not a frame or is corrupt
+static int decode_next(nviz_reader * r)
+{
+	nviz_header * h = &r->r_header;
+	const unsigned char * payload;
+	int type;
+	size_t len;
+
+	if (record_header(r, r->r_next_offset, &type, &len) || (type != RECORD_KEY && type != RECORD_DELTA) || len > r->r_payload_size)
+	{
+		return 1;
+	}
+
+	off_t payload_offset = r->r_next_offset + RECORD_HD;
+
+	if (r->r_map != NULL)
+	{
+		if ((uint64_t) payload_offset + len > r->r_map_size)
+		{
+			return 1;
+		}
+
+		payload = (const unsigned char *) r->r_map + payload_offset;
+	}
+	else
+	{
+		if (nviz_read_at(r, (char *) r->r_payload, len, payload_offset))
+		{
+			return 1;
+		}
+
+		payload = r->r_payload;
+	}
+
+	int failed;
+
+	if (type == RECORD_KEY)
+	{
+		failed = decode_cells(r->r_frame, h->h_col * h->h_row, payload, len, 1);
+	}
+	else
+	{
+		int shift = len > 0 ? (int8_t) payload[0] : 0;
+
+		// a delta needs the frame before it
+		if (len == 0 || r->r_decoded_index != r->r_next_index - 1 || shift <= -h->h_row || shift >= h->h_row)
+		{
+			return 1;
+		}
+
+		shift_rows(r->r_frame, h->h_col, h->h_row, shift);
+		failed = decode_cells(r->r_frame, h->h_col * h->h_row, payload + 1, len - 1, 0);
+	}
+
+	if (failed)
+	{
+		r->r_decoded_index = -1;
+		return 1;
+	}
+
+	r->r_decoded_index = r->r_next_index++;
+	r->r_next_offset = payload_offset + len;
+
+	return 0;
+}
+
+// decode a frame into r_frame, going on from the frame in it or starting over at the keyframe before
+// a pipe has no index, so it can only go forward
+static int decode_frame(nviz_reader * r, int64_t frame_index)
+{
+	if (r->r_decoded_index == frame_index)
+	{
+		return 0;
+	}
+
+	// the last keyframe at or before the frame
+	int64_t lo = 0;
+	int64_t hi = r->r_key_count;
+
+	while (lo < hi)
+	{
+		int64_t mid = lo + (hi - lo) / 2;
+
+		if (r->r_keys[2 * mid] <= frame_index)
+		{
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+
+	if (lo > 0 && (r->r_decoded_index < r->r_keys[2 * (lo - 1)] || r->r_decoded_index > frame_index))
+	{
+		r->r_decoded_index = -1;
+		r->r_next_index = r->r_keys[2 * (lo - 1)];
+		r->r_next_offset = r->r_keys[2 * (lo - 1) + 1];
+	}
+
+	while (r->r_decoded_index != frame_index)
+	{
+		if (r->r_next_index > frame_index || decode_next(r))
+		{
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+// note a keyframe, the index grows as it is needed
+static void add_key(int64_t ** keys, int64_t * count, int64_t * size, int64_t frame_index, off_t off)
+{
+	if (*count == *size)
+	{
+		*size = *size > 0 ? 2 * *size : 64;
+		*keys = realloc(*keys, 2 * *size * sizeof(int64_t));
+	}
+
+	(*keys)[2 * *count] = frame_index;
+	(*keys)[2 * *count + 1] = off;
+	(*count)++;
+}
+
+// load the keyframe index of a regular delta file from its footer, returns 1 if it has none
+static int load_index(nviz_reader * r)
+{
+	unsigned char footer[FOOTER_SIZE];
+	int type;
+	size_t len;
+
+	if (r->r_file_size < r->r_header.h_data_offset + RECORD_HD + FOOTER_SIZE || nviz_read_at(r, (char *) footer, FOOTER_SIZE, r->r_file_size - FOOTER_SIZE) || memcmp(footer + 8, "NVZI", 4) != 0)
+	{
+		return 1;
+	}
+
+	off_t index_offset = get_le(footer, 8);
+
+	if (index_offset < r->r_header.h_data_offset || index_offset > r->r_file_size - FOOTER_SIZE - RECORD_HD
+		|| record_header(r, index_offset, &type, &len) || type != RECORD_INDEX || len % 16 != 0
+		|| (off_t) len != r->r_file_size - FOOTER_SIZE - RECORD_HD - index_offset || len == 0)
+	{
+		return 1;
+	}
+
+	unsigned char * index = malloc(len);
+
+	if (nviz_read_at(r, (char *) index, len, index_offset + RECORD_HD))
+	{
+		free(index);
+		return 1;
+	}
+
+	r->r_key_count = len / 16;
+	r->r_keys = malloc(len);
+
+	// keyframes go forward through the file, starting with the first frame
+	int64_t i;
+	int failed = 0;
+
+	for (i = 0; i < r->r_key_count; i++)
+	{
+		r->r_keys[2 * i] = get_le(index + 16 * i, 8);
+		r->r_keys[2 * i + 1] = get_le(index + 16 * i + 8, 8);
+
+		if (i == 0 ? r->r_keys[0] != 0 || r->r_keys[1] != r->r_header.h_data_offset : r->r_keys[2 * i] <= r->r_keys[2 * i - 2] || r->r_keys[2 * i + 1] <= r->r_keys[2 * i - 1] || r->r_keys[2 * i + 1] >= index_offset)
+		{
+			failed = 1;
+		}
+	}
+
+	free(index);
+
+	if (failed)
+	{
+		free(r->r_keys);
+		r->r_keys = NULL;
+		r->r_key_count = 0;
+	}
+
+	return failed;
+}
+
+// count the frames of a regular delta file by walking its records, noting every keyframe
+// for a file with no frame count or index, like one whose writer never finished
+static int64_t scan_records(nviz_reader * r)
+{
+	int64_t key_size = 0;
+	int64_t frames = 0;
+	off_t off = r->r_header.h_data_offset;
+	int type;
+	size_t len;
+
+	while (!record_header(r, off, &type, &len) && (type == RECORD_KEY || type == RECORD_DELTA) && len <= r->r_payload_size && off + RECORD_HD + (off_t) len <= r->r_file_size)
+	{
+		if (type == RECORD_KEY)
+		{
+			add_key(&r->r_keys, &r->r_key_count, &key_size, frames, off);
+		}
+		else if (frames == 0)
+		{
+			break;
+		}
+
+		off += RECORD_HD + len;
+		frames++;
+	}
+
+	return frames;
+}
+
+// close a nviz file opened by nviz_open
+void nviz_close(nviz_reader * r)
+{
+	if (r->r_map != NULL)
+	{
+		munmap(r->r_map, r->r_map_size);
+	}
+
+	free(r->r_frame);
+	free(r->r_keys);
+	free(r->r_payload);
+	close(r->r_fd);
+
+	r->r_map = NULL;
+	r->r_frame = NULL;
+	r->r_keys = NULL;
+	r->r_payload = NULL;
+	r->r_fd = -1;
+}
+
+// open a nviz file and validate its header, returns 1 if it could not be opened or holds no frames
+// a regular file is mapped whole, so frames are served straight out of the page cache
+int nviz_open(nviz_reader * r, const char * path)
+{
+	memset(r, 0, sizeof(nviz_reader));
+
+	r->r_cancel_fd = -1;
+	r->r_fd = open(path, O_RDONLY);
+
+	if (r->r_fd < 0)
+	{
+		return 1;
+	}
+
+	// only regular files know their size
+	struct stat st;
+
+	if (fstat(r->r_fd, &st))
+	{
+		close(r->r_fd);
+		return 1;
+	}
+
+	int regular = S_ISREG(st.st_mode);
+	r->r_file_size = regular ? st.st_size : 0;
+
+	// the legacy header is a prefix of the versioned one
+	unsigned char header[NVIZ_HD_V1];
+
+	if ((regular && r->r_file_size < NVIZ_HD)
+		|| nviz_read_at(r, (char *) header, NVIZ_HD, 0)
+		|| (nviz_header_size(header) == NVIZ_HD_V1 && nviz_read_at(r, (char *) header + NVIZ_HD, NVIZ_HD_V1 - NVIZ_HD, NVIZ_HD))
+		|| nviz_parse_header(header, &r->r_header))
+	{
+		close(r->r_fd);
+		return 1;
+	}
+
+	nviz_header * h = &r->r_header;
+
+	// a file bigger than the address space, on a 32 bit build, is read instead
+	r->r_map = NULL;
+
+	if (regular && (uint64_t) r->r_file_size <= SIZE_MAX)
+	{
+		r->r_map_size = r->r_file_size;
+		r->r_map = mmap(NULL, r->r_map_size, PROT_READ, MAP_SHARED, r->r_fd, 0);
+
+		if (r->r_map == MAP_FAILED)
+		{
+			r->r_map = NULL;
+		}
+		else
+		{
+			madvise(r->r_map, r->r_map_size, MADV_SEQUENTIAL);
+		}
+	}
+
+	// a file written without knowing its length holds as many whole frames as fit
+	// read from a pipe it is a live stream, read until the writer closes it
+	r->r_frames = h->h_frames;
+	r->r_live = !regular && r->r_frames == 0;
+	r->r_decoded_index = -1;
+	r->r_next_offset = h->h_data_offset;
+
+	int64_t frames_in_file = r->r_frames;
+
+	if (h->h_version == NVIZ_VERSION_DELTA)
+	{
+		// every frame is decoded into r_frame, from the nearest keyframe when the file has an index
+		r->r_payload_size = DELTA_MAX_PAYLOAD(h->h_col * h->h_row);
+
+		if (r->r_map == NULL)
+		{
+			r->r_payload = malloc(r->r_payload_size);
+		}
+
+		if (regular && (r->r_frames == 0 || load_index(r)))
+		{
+			frames_in_file = scan_records(r);
+		}
+	}
+	else if (regular)
+	{
+		// counted in frames, so a corrupt frame count cannot overflow the offset
+		frames_in_file = (r->r_file_size - h->h_data_offset) / (off_t) h->h_frame_bytes;
+		r->r_in_place = r->r_map != NULL;
+	}
+
+	if (r->r_frames == 0)
+	{
+		r->r_frames = frames_in_file;
+	}
+
+	// check that the file contains at least one frame, and every frame of its count
+	if ((!r->r_live && r->r_frames == 0) || frames_in_file < r->r_frames)
+	{
+		nviz_close(r);
+		return 1;
+	}
+
+	if (!r->r_in_place)
+	{
+		r->r_frame = malloc(h->h_frame_bytes);
+	}
+
+	return 0;
+}
+
+// copy a frame into frame, returns 1 if the file has no such frame
+// a reader thread can use this on its own, as long as nothing else reads the file
+int nviz_read_frame(nviz_reader * r, int64_t frame_index, char * frame)
+{
+	if (frame_index < 0 || (r->r_frames > 0 && frame_index >= r->r_frames))
+	{
+		return 1;
+	}
+
+	if (r->r_header.h_version == NVIZ_VERSION_DELTA)
+	{
+		if (decode_frame(r, frame_index))
+		{
+			return 1;
+		}
+
+		memcpy(frame, r->r_frame, r->r_header.h_frame_bytes);
+
+		return 0;
+	}
+
+	if (r->r_in_place)
+	{
+		memcpy(frame, r->r_map + nviz_frame_offset(&r->r_header, frame_index), r->r_header.h_frame_bytes);
+
+		return 0;
+	}
+
+	return nviz_read_at(r, frame, r->r_header.h_frame_bytes, nviz_frame_offset(&r->r_header, frame_index));
+}
+
+// a frame, returns NULL if the file has no such frame
+// raw frames of a mapped file are served in place, otherwise the frame is read or decoded into a buffer that the next call reuses
+const char * nviz_frame(nviz_reader * r, int64_t frame_index)
+{
+	if (frame_index < 0 || (r->r_frames > 0 && frame_index >= r->r_frames))
+	{
+		return NULL;
+	}
+
+	if (r->r_in_place)
+	{
+		return r->r_map + nviz_frame_offset(&r->r_header, frame_index);
+	}
+
+	if (r->r_header.h_version == NVIZ_VERSION_DELTA)
+	{
+		return decode_frame(r, frame_index) ? NULL : r->r_frame;
+	}
+
+	return nviz_read_at(r, r->r_frame, r->r_header.h_frame_bytes, nviz_frame_offset(&r->r_header, frame_index)) ? NULL : r->r_frame;
+}
+
+// start iterating over the frames of a file from the first
+void nviz_iter_init(nviz_iter * it, nviz_reader * r)
+{
+	it->i_reader = r;
+	it->i_index = -1;
+	it->i_frame = NULL;
+}
+
+// move on to the next frame, returns 0 when there are no more, a live stream ends when its writer closes it
+int nviz_iter_next(nviz_iter * it)
+{
+	it->i_index++;
+	it->i_frame = nviz_frame(it->i_reader, it->i_index);
+
+	return it->i_frame != NULL;
+}
+
+//----------------------------------------------------				// WRITER
+
+// start a nviz file on an open file descriptor and write its header, returns 1 if it could not be written
+// version is NVIZ_VERSION_RAW or NVIZ_VERSION_DELTA, frames is 0 when the length is not known yet
+// buffer_bytes 0 writes each frame straight out
+int nviz_create_fd(nviz_writer * w, int fd, int version, int col, int row, int fps, int64_t frames, size_t buffer_bytes)
+{
+	memset(w, 0, sizeof(nviz_writer));
+
+	w->w_fd = fd;
+
+	if (fd < 0 || (version != NVIZ_VERSION_RAW && version != NVIZ_VERSION_DELTA) || col < 1 || col > NVIZ_MAX_COL || row < 1 || row > NVIZ_MAX_ROW || fps < 1 || fps > 255 || frames < 0)
+	{
+		return 1;
+	}
+
+	nviz_header * h = &w->w_header;
+
+	h->h_version = version;
+	h->h_col = col;
+	h->h_row = row;
+	h->h_fps = fps;
+	h->h_frames = frames;
+	h->h_data_offset = NVIZ_HD_V1;
+	h->h_frame_bytes = (size_t) CH_BYTS * col * row;
+
+	struct stat st;
+	w->w_seekable = fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+	w->w_offset = NVIZ_HD_V1;
+
+	if (version == NVIZ_VERSION_DELTA)
+	{
+		// records vary in size, the buffer takes as many as fit
+		w->w_buf_size = buffer_bytes;
+		w->w_prev = malloc(h->h_frame_bytes);
+		w->w_record = malloc(RECORD_HD + DELTA_MAX_PAYLOAD(col * row));
+		w->w_key_interval = fps;
+	}
+	else if (buffer_bytes >= h->h_frame_bytes)
+	{
+		// the buffer holds whole frames
+		w->w_buf_size = buffer_bytes - buffer_bytes % h->h_frame_bytes;
+	}
+
+	if (w->w_buf_size > 0)
+	{
+		w->w_buf = malloc(w->w_buf_size);
+	}
+
+	unsigned char header[NVIZ_HD_V1];
+
+	nviz_make_header(header, version, col, row, fps, frames);
+
+	return nviz_write_all(fd, (char *) header, NVIZ_HD_V1);
+}
+
+// create a nviz file and write its header, - is stdout
+int nviz_create(nviz_writer * w, const char * path, int version, int col, int row, int fps, int64_t frames, size_t buffer_bytes)
+{
+	int fd = strcmp(path, "-") == 0 ? STDOUT_FILENO : open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+
+	return nviz_create_fd(w, fd, version, col, row, fps, frames, buffer_bytes);
+}
+
+// write out the buffered frames
+int nviz_flush(nviz_writer * w)
+{
+	int failed = nviz_write_all(w->w_fd, w->w_buf, w->w_buf_len);
+
+	w->w_buf_len = 0;
+
+	return failed;
+}
+
+// append bytes to the file, they go out once the buffer is full, or straight away if they do not fit in it
+static int put_bytes(nviz_writer * w, const char * bytes, size_t len)
+{
+	w->w_offset += len;
+
+	if (w->w_buf_len + len > w->w_buf_size && nviz_flush(w))
+	{
+		return 1;
+	}
+
+	if (len > w->w_buf_size)
+	{
+		return nviz_write_all(w->w_fd, bytes, len);
+	}
+
+	memcpy(w->w_buf + w->w_buf_len, bytes, len);
+	w->w_buf_len += len;
+
+	return 0;
+}
+
+// code a frame as a keyframe or as a delta against the frame before, whichever row shift matches it best
+static int write_delta_frame(nviz_writer * w, const char * frame)
+{
+	nviz_header * h = &w->w_header;
+	unsigned char * payload = w->w_record + RECORD_HD;
+	size_t len;
+
+	if (w->w_frames % w->w_key_interval == 0)
+	{
+		add_key(&w->w_keys, &w->w_key_count, &w->w_key_size, w->w_frames, w->w_offset);
+
+		w->w_record[0] = RECORD_KEY;
+		len = code_cells(payload, frame, NULL, h->h_col * h->h_row);
+	}
+	else
+	{
+		// no shift, the last shift, and a row either way, which covers anything that scrolls a row at a time
+		int candidates[4] = { 0, w->w_shift, 1, -1 };
+		int shift = 0;
+		int64_t best = -1;
+
+		int i;
+		for (i = 0; i < 4; i++)
+		{
+			if (candidates[i] > -h->h_row && candidates[i] < h->h_row && (i == 0 || candidates[i] != 0))
+			{
+				int64_t matches = shift_matches(frame, w->w_prev, h->h_col, h->h_row, candidates[i]);
+
+				if (matches > best)
+				{
+					best = matches;
+					shift = candidates[i];
+				}
+			}
+		}
+
+		shift_rows(w->w_prev, h->h_col, h->h_row, shift);
+
+		w->w_record[0] = RECORD_DELTA;
+		w->w_shift = shift;
+		payload[0] = (int8_t) shift;
+		len = 1 + code_cells(payload + 1, frame, w->w_prev, h->h_col * h->h_row);
+	}
+
+	memcpy(w->w_prev, frame, h->h_frame_bytes);
+	put_le(w->w_record + 1, len, 4);
+
+	return put_bytes(w, (char *) w->w_record, RECORD_HD + len);
+}
+
+// append a frame, it goes out once the buffer is full
+int nviz_write_frame(nviz_writer * w, const char * frame)
+{
+	if (w->w_header.h_version == NVIZ_VERSION_DELTA)
+	{
+		int failed = write_delta_frame(w, frame);
+
+		w->w_frames++;
+
+		return failed;
+	}
+
+	w->w_frames++;
+
+	return put_bytes(w, frame, w->w_header.h_frame_bytes);
+}
+
+// write count frames where they go in the file, past the buffer, so threads can each write their own part of a regular file
+// frames written this way are not counted towards a frame count that nviz_finish fills in
+// delta frames vary in size, so they can only be written in order, returns 1 for them
+int nviz_write_frames_at(nviz_writer * w, int64_t frame_index, const char * frames, int64_t count)
+{
+	if (w->w_header.h_version == NVIZ_VERSION_DELTA)
+	{
+		return 1;
+	}
+
+	return nviz_write_at(w->w_fd, frames, w->w_header.h_frame_bytes * count, nviz_frame_offset(&w->w_header, frame_index));
+}
+
+// the keyframe index and the footer that points at it, so a reader can seek without walking every record
+static int write_index(nviz_writer * w)
+{
+	size_t len = 16 * w->w_key_count;
+	unsigned char * index = malloc(RECORD_HD + len + FOOTER_SIZE);
+	off_t index_offset = w->w_offset;
+
+	index[0] = RECORD_INDEX;
+	put_le(index + 1, len, 4);
+
+	int64_t i;
+	for (i = 0; i < w->w_key_count; i++)
+	{
+		put_le(index + RECORD_HD + 16 * i, w->w_keys[2 * i], 8);
+		put_le(index + RECORD_HD + 16 * i + 8, w->w_keys[2 * i + 1], 8);
+	}
+
+	put_le(index + RECORD_HD + len, index_offset, 8);
+	memcpy(index + RECORD_HD + len + 8, "NVZI", 4);
+
+	int failed = put_bytes(w, (char *) index, RECORD_HD + len + FOOTER_SIZE);
+
+	free(index);
+
+	return failed;
+}
+
+// flush and close the file, returns 1 if any of it could not be written
+// a regular file started with 0 frames gets the count of frames that were written
+int nviz_finish(nviz_writer * w)
+{
+	int failed = 0;
+
+	if (w->w_header.h_version == NVIZ_VERSION_DELTA && w->w_key_count > 0)
+	{
+		failed = write_index(w);
+	}
+
+	if (nviz_flush(w))
+	{
+		failed = 1;
+	}
+
+	if (!failed && w->w_header.h_frames == 0 && w->w_seekable && w->w_frames > 0)
+	{
+		unsigned char header[NVIZ_HD_V1];
+
+		nviz_make_header(header, w->w_header.h_version, w->w_header.h_col, w->w_header.h_row, w->w_header.h_fps, w->w_frames);
+		failed = nviz_write_at(w->w_fd, (char *) header, NVIZ_HD_V1, 0);
+	}
+
+	if (close(w->w_fd))
+	{
+		failed = 1;
+	}
+
+	free(w->w_buf);
+	free(w->w_prev);
+	free(w->w_record);
+	free(w->w_keys);
+	w->w_buf = NULL;
+	w->w_prev = NULL;
+	w->w_record = NULL;
+	w->w_keys = NULL;
+
+	return failed;
+}
+
+//----------------------------------------------------				// NFRAME
+
+// read a whole nframe file, returns 1 if it could not be opened or is cut short
+int nframe_read(nframe * f, const char * path)
+{
+	f->f_cells = NULL;
+
+	FILE * nframe_file = fopen(path, "rb");
+
+	if (nframe_file == NULL)
+	{
+		return 1;
+	}
+
+	unsigned char header[NFRM_HD];
+
+	if (fread(header, 1, NFRM_HD, nframe_file) != NFRM_HD || header[0] == 0 || header[1] == 0)
+	{
+		fclose(nframe_file);
+		return 1;
+	}
+
+	f->f_col = header[0];
+	f->f_row = header[1];
+
+	size_t cell_bytes = (size_t) CH_BYTS * f->f_col * f->f_row;
+	f->f_cells = malloc(cell_bytes);
+
+	if (fread(f->f_cells, 1, cell_bytes, nframe_file) != cell_bytes)
+	{
+		nframe_free(f);
+		fclose(nframe_file);
+		return 1;
+	}
+
+	fclose(nframe_file);
+
+	return 0;
+}
+
+// write an nframe file with a single open, write and close, returns 1 if it could not be written
+// the header and cells go out together so that splitting a long .nviz costs few syscalls per frame
+int nframe_write(const char * path, int col, int row, const char * cells)
+{
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+
+	if (fd < 0)
+	{
+		return 1;
+	}
+
+	unsigned char header[NFRM_HD] = { col, row };
+	size_t cell_bytes = (size_t) CH_BYTS * col * row;
+	struct iovec iov[2] = { { header, NFRM_HD }, { (void *) cells, cell_bytes } };
+
+	ssize_t written;
+	do
+	{
+		written = writev(fd, iov, 2);
+	} while (written < 0 && errno == EINTR);
+
+	int failed = written < 0;
+
+	// a short write is finished a piece at a time
+	if (!failed && (size_t) written < NFRM_HD + cell_bytes)
+	{
+		if (written < NFRM_HD)
+		{
+			failed = nviz_write_all(fd, (const char *) header + written, NFRM_HD - written) || nviz_write_all(fd, cells, cell_bytes);
+		}
+		else
+		{
+			failed = nviz_write_all(fd, cells + (written - NFRM_HD), cell_bytes - (written - NFRM_HD));
+		}
+	}
+
+	if (close(fd))
+	{
+		failed = 1;
+	}
+
+	return failed;
+}
+
+// free the cells of an nframe read by nframe_read
+void nframe_free(nframe * f)
+{
+	free(f->f_cells);
+	f->f_cells = NULL;
+}
+
+//----------------------------------------------------				// NFRAME ARCHIVE
+
+// a .nframes archive holds every frame of a .nviz in one file, so an export is one inode instead of one per frame
+//
+//   header		0, "NFA", the version and 3 zero bytes
+//   frames		each stored frame is a whole .nframe, col, row and cells, frames with the same cells are stored once
+//   index		the 64 bit little endian offset of every frame, in frame order
+//   footer		the 64 bit frame count, the 64 bit offset of the index and "NFAI"
+//
+// the footer finds the index and the index finds any frame, so reading frame n takes the same time for every n
+
+#define NFRAMES_FOOTER 20
+#define NFRAMES_HASH_START 1024
+#define NFRAMES_MAX_FRAME (NFRM_HD + CH_BYTS * NVIZ_MAX_COL * NVIZ_MAX_ROW)
+
+static int archive_read_at(nframes_reader * a, char * buf, size_t len, off_t off)
+{
+	if (off < 0 || off > a->ar_file_size || len > (uint64_t) (a->ar_file_size - off))
+	{
+		return 1;
+	}
+
+	if (a->ar_map != NULL)
+	{
+		memcpy(buf, a->ar_map + off, len);
+		return 0;
+	}
+
+	size_t done = 0;
+
+	while (done < len)
+	{
+		ssize_t n = pread(a->ar_fd, buf + done, len - done, off + done);
+
+		if (n < 0 && errno == EINTR)
+		{
+			continue;
+		}
+
+		if (n <= 0)
+		{
+			return 1;
+		}
+
+		done += n;
+	}
+
+	return 0;
+}
+
+// close an archive opened with nframes_open
+void nframes_close(nframes_reader * a)
+{
+	if (a->ar_map != NULL)
+	{
+		munmap(a->ar_map, a->ar_map_size);
+		a->ar_map = NULL;
+	}
+
+	close(a->ar_fd);
+}
+
+// open an archive and check its footer and index, returns 1 if it is not an archive this library can read
+int nframes_open(nframes_reader * a, const char * path)
+{
+	memset(a, 0, sizeof(nframes_reader));
+
+	a->ar_fd = open(path, O_RDONLY);
+
+	if (a->ar_fd < 0)
+	{
+		return 1;
+	}
+
+	// the index is found from the end, so only a regular file can be an archive
+	struct stat st;
+
+	if (fstat(a->ar_fd, &st) || !S_ISREG(st.st_mode) || st.st_size < NFRAMES_HD + NFRAMES_FOOTER)
+	{
+		close(a->ar_fd);
+		return 1;
+	}
+
+	a->ar_file_size = st.st_size;
+
+	unsigned char header[NFRAMES_HD];
+	unsigned char footer[NFRAMES_FOOTER];
+
+	if (archive_read_at(a, (char *) header, NFRAMES_HD, 0)
+		|| header[0] != 0 || memcmp(header + 1, "NFA", 3) != 0 || header[4] != NFRAMES_VERSION
+		|| archive_read_at(a, (char *) footer, NFRAMES_FOOTER, a->ar_file_size - NFRAMES_FOOTER)
+		|| memcmp(footer + 16, "NFAI", 4) != 0)
+	{
+		close(a->ar_fd);
+		return 1;
+	}
+
+	// counted in index entries, so a corrupt frame count cannot overflow the index size
+	uint64_t frames = get_le(footer, 8);
+	uint64_t index_offset = get_le(footer + 8, 8);
+	uint64_t index_end = a->ar_file_size - NFRAMES_FOOTER;
+
+	if (index_offset < NFRAMES_HD || index_offset > index_end || frames != (index_end - index_offset) / 8 || (index_end - index_offset) % 8 != 0)
+	{
+		close(a->ar_fd);
+		return 1;
+	}
+
+	a->ar_frames = frames;
+	a->ar_index_offset = index_offset;
+
+	// a file bigger than the address space, on a 32 bit build, is read instead
+	if ((uint64_t) a->ar_file_size <= SIZE_MAX)
+	{
+		a->ar_map_size = a->ar_file_size;
+		a->ar_map = mmap(NULL, a->ar_map_size, PROT_READ, MAP_SHARED, a->ar_fd, 0);
+
+		if (a->ar_map == MAP_FAILED)
+		{
+			a->ar_map = NULL;
+		}
+	}
+
+	return 0;
+}
+
+// read frame frame_index of an archive into f, free it with nframe_free, returns 1 if it is out of range or corrupt
+int nframes_read(nframes_reader * a, int64_t frame_index, nframe * f)
+{
+	f->f_cells = NULL;
+
+	unsigned char entry[8];
+	unsigned char header[NFRM_HD];
+
+	if (frame_index < 0 || frame_index >= a->ar_frames
+		|| archive_read_at(a, (char *) entry, 8, a->ar_index_offset + 8 * frame_index))
+	{
+		return 1;
+	}
+
+	// a frame lies wholly between the header and the index
+	uint64_t off = get_le(entry, 8);
+
+	if (off < NFRAMES_HD || off > (uint64_t) a->ar_index_offset - NFRM_HD
+		|| archive_read_at(a, (char *) header, NFRM_HD, off) || header[0] == 0 || header[1] == 0)
+	{
+		return 1;
+	}
+
+	f->f_col = header[0];
+	f->f_row = header[1];
+
+	size_t cell_bytes = (size_t) CH_BYTS * f->f_col * f->f_row;
+
+	if (off + NFRM_HD + cell_bytes > (uint64_t) a->ar_index_offset)
+	{
+		return 1;
+	}
+
+	f->f_cells = malloc(cell_bytes);
+
+	if (archive_read_at(a, f->f_cells, cell_bytes, off + NFRM_HD))
+	{
+		nframe_free(f);
+		return 1;
+	}
+
+	return 0;
+}
+
+// fnv-1a, stored frames are found by the hash of their col, row and cells
+static uint64_t hash_bytes(uint64_t hash, const unsigned char * bytes, size_t len)
+{
+	size_t i;
+	for (i = 0; i < len; i++)
+	{
+		hash = (hash ^ bytes[i]) * 1099511628211ULL;
+	}
+
+	return hash;
+}
+
+static int archive_flush(nframes_writer * a)
+{
+	int failed = nviz_write_all(a->aw_fd, a->aw_buf, a->aw_buf_len);
+
+	a->aw_buf_len = 0;
+
+	return failed;
+}
+
+static int archive_put_bytes(nframes_writer * a, const char * bytes, size_t len)
+{
+	if (a->aw_buf_len + len > a->aw_buf_size && archive_flush(a))
+	{
+		return 1;
+	}
+
+	a->aw_offset += len;
+
+	if (len > a->aw_buf_size)
+	{
+		return nviz_write_all(a->aw_fd, bytes, len);
+	}
+
+	memcpy(a->aw_buf + a->aw_buf_len, bytes, len);
+	a->aw_buf_len += len;
+
+	return 0;
+}
+
+// whether the frame stored at off is the len bytes of frame, it is still in the buffer or read back from the file
+static int archive_stored_equals(nframes_writer * a, off_t off, const char * frame, size_t len)
+{
+	off_t buf_start = a->aw_offset - a->aw_buf_len;
+
+	if (off >= buf_start)
+	{
+		return (size_t) (off - buf_start) + len <= a->aw_buf_len && memcmp(a->aw_buf + (off - buf_start), frame, len) == 0;
+	}
+
+	size_t done = 0;
+
+	while (done < len)
+	{
+		ssize_t n = pread(a->aw_fd, a->aw_compare + done, len - done, off + done);
+
+		if (n < 0 && errno == EINTR)
+		{
+			continue;
+		}
+
+		if (n <= 0)
+		{
+			return 0;
+		}
+
+		done += n;
+	}
+
+	return memcmp(a->aw_compare, frame, len) == 0;
+}
+
+static void archive_insert(nframes_writer * a, uint64_t hash, off_t off)
+{
+	int64_t mask = a->aw_hash_size - 1;
+	int64_t i = hash & mask;
+
+	while (a->aw_hash_offsets[i] >= 0)
+	{
+		i = (i + 1) & mask;
+	}
+
+	a->aw_hashes[i] = hash;
+	a->aw_hash_offsets[i] = off;
+}
+
+// create an archive, it is read back to find repeated frames, so it has to be a file and not a pipe
+int nframes_create(nframes_writer * a, const char * path)
+{
+	memset(a, 0, sizeof(nframes_writer));
+
+	a->aw_fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0666);
+
+	if (a->aw_fd < 0)
+	{
+		return 1;
+	}
+
+	a->aw_buf_size = NVIZ_WRITE_BUFFER;
+	a->aw_buf = malloc(a->aw_buf_size);
+	a->aw_frame = malloc(NFRAMES_MAX_FRAME);
+	a->aw_compare = malloc(NFRAMES_MAX_FRAME);
+	a->aw_hash_size = NFRAMES_HASH_START;
+	a->aw_hashes = malloc(a->aw_hash_size * sizeof(uint64_t));
+	a->aw_hash_offsets = malloc(a->aw_hash_size * sizeof(int64_t));
+	memset(a->aw_hash_offsets, -1, a->aw_hash_size * sizeof(int64_t));
+
+	unsigned char header[NFRAMES_HD] = { 0, 'N', 'F', 'A', NFRAMES_VERSION, 0, 0, 0 };
+
+	return archive_put_bytes(a, (char *) header, NFRAMES_HD);
+}
+
+// add the next frame, stored only if no frame before it has the same col, row and cells, returns 1 if it could not be written
+int nframes_write_frame(nframes_writer * a, int col, int row, const char * cells)
+{
+	size_t len = NFRM_HD + (size_t) CH_BYTS * col * row;
+	unsigned char header[NFRM_HD] = { col, row };
+	uint64_t hash = hash_bytes(hash_bytes(14695981039346656037ULL, header, NFRM_HD), (const unsigned char *) cells, len - NFRM_HD);
+
+	// stored as it would be in a .nframe file, the header then the cells
+	char * frame = a->aw_frame;
+	memcpy(frame, header, NFRM_HD);
+	memcpy(frame + NFRM_HD, cells, len - NFRM_HD);
+
+	int64_t mask = a->aw_hash_size - 1;
+	int64_t i = hash & mask;
+	int64_t off = -1;
+
+	while (a->aw_hash_offsets[i] >= 0)
+	{
+		if (a->aw_hashes[i] == hash && archive_stored_equals(a, a->aw_hash_offsets[i], frame, len))
+		{
+			off = a->aw_hash_offsets[i];
+			break;
+		}
+
+		i = (i + 1) & mask;
+	}
+
+	int failed = 0;
+
+	if (off < 0)
+	{
+		off = a->aw_offset;
+		failed = archive_put_bytes(a, frame, len);
+
+		// grown before it is half full, so a probe always ends at an empty slot
+		if (++a->aw_stored * 2 > a->aw_hash_size)
+		{
+			uint64_t * hashes = a->aw_hashes;
+			int64_t * offsets = a->aw_hash_offsets;
+			int64_t size = a->aw_hash_size;
+
+			a->aw_hash_size *= 2;
+			a->aw_hashes = malloc(a->aw_hash_size * sizeof(uint64_t));
+			a->aw_hash_offsets = malloc(a->aw_hash_size * sizeof(int64_t));
+			memset(a->aw_hash_offsets, -1, a->aw_hash_size * sizeof(int64_t));
+
+			for (i = 0; i < size; i++)
+			{
+				if (offsets[i] >= 0)
+				{
+					archive_insert(a, hashes[i], offsets[i]);
+				}
+			}
+
+			free(hashes);
+			free(offsets);
+		}
+
+		archive_insert(a, hash, off);
+	}
+
+	if (a->aw_frames == a->aw_index_size)
+	{
+		a->aw_index_size = a->aw_index_size ? 2 * a->aw_index_size : 1024;
+		a->aw_index = realloc(a->aw_index, a->aw_index_size * sizeof(int64_t));
+	}
+
+	a->aw_index[a->aw_frames++] = off;
+
+	return failed;
+}
+
+// write the index and footer and close the archive, returns 1 if any of it could not be written
+int nframes_finish(nframes_writer * a)
+{
+	off_t index_offset = a->aw_offset;
+	int failed = 0;
+	unsigned char entry[8];
+
+	int64_t i;
+	for (i = 0; i < a->aw_frames && !failed; i++)
+	{
+		put_le(entry, a->aw_index[i], 8);
+		failed = archive_put_bytes(a, (char *) entry, 8);
+	}
+
+	unsigned char footer[NFRAMES_FOOTER];
+	put_le(footer, a->aw_frames, 8);
+	put_le(footer + 8, index_offset, 8);
+	memcpy(footer + 16, "NFAI", 4);
+
+	if (failed || archive_put_bytes(a, (char *) footer, NFRAMES_FOOTER) || archive_flush(a))
+	{
+		failed = 1;
+	}
+
+	if (close(a->aw_fd))
+	{
+		failed = 1;
+	}
+
+	free(a->aw_buf);
+	free(a->aw_frame);
+	free(a->aw_compare);
+	free(a->aw_index);
+	free(a->aw_hashes);
+	free(a->aw_hash_offsets);
+	a->aw_buf = NULL;
+	a->aw_frame = NULL;
+	a->aw_compare = NULL;
+	a->aw_index = NULL;
+	a->aw_hashes = NULL;
+	a->aw_hash_offsets = NULL;
+
+	return failed;
+}
@@ -0,0 +1,155 @@
+// libnviz - reads and writes the .nviz video/visual files and .nframe ascii art files of every nviz tool
+// made by Nikola Whallon (https://github.com/nikolawhallon/nviz-project, nikola.whallon@gmail.com)
+
+#ifndef NVIZ_H
+#define NVIZ_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#define NVIZ_HD 5				// legacy header, col, row, fps and 16 bit seconds
+#define NVIZ_HD_V1 16				// versioned header, 0, "NVZ", version, col, row, fps and a 64 bit frame count
+#define NVIZ_VERSION 2				// the newest version this library reads
+#define NVIZ_VERSION_RAW 1			// every frame is stored whole
+#define NVIZ_VERSION_DELTA 2			// keyframes and delta frames, records of varying size, see nviz.c
+#define NFRM_HD 2				// nframe header, col and row
+#define NFRAMES_HD 8				// nframe archive header, 0, "NFA", version and 3 zero bytes
+#define NFRAMES_VERSION 1
+#define CH_BYTS 2				// a cell is a color and a character
+#define NVIZ_MAX_COL 255			// col and row are stored in a byte
+#define NVIZ_MAX_ROW 255
+#define NVIZ_WRITE_BUFFER (1 << 20)		// frames are written in batches of about this size
+
+typedef struct {
+	int h_version;				// 0 for the legacy header
+	int h_col;
+	int h_row;
+	int h_fps;
+	int64_t h_frames;			// 0 when the length was not known when the file was written
+	off_t h_data_offset;			// the size of the header, the first frame starts here
+	size_t h_frame_bytes;
+} nviz_header;
+
+typedef struct {
+	int r_fd;
+	nviz_header r_header;
+	int64_t r_frames;			// frames in the file, 0 for a live stream that is read until it ends
+	int r_live;				// a pipe of unknown length, it can only be read forwards
+	off_t r_file_size;			// 0 when the file is not a regular file
+	char * r_map;				// whole file mapping, NULL when frames are read instead
+	size_t r_map_size;
+	int r_in_place;				// raw frames in the mapping, they can be pointed at without a copy
+	off_t r_stream_pos;			// how far a pipe has been read
+	int r_cancel_fd;			// -1, or an fd that fails a read waiting on a pipe once it is readable
+	char * r_frame;				// the frame nviz_frame reads or decodes into when it is not in place
+
+	// delta files, decoded forward from the nearest keyframe
+	int64_t * r_keys;			// frame index and offset pairs of every keyframe, NULL for a pipe
+	int64_t r_key_count;
+	int64_t r_decoded_index;		// the frame in r_frame, -1 when none is
+	int64_t r_next_index;			// the frame of the record at r_next_offset
+	off_t r_next_offset;
+	unsigned char * r_payload;		// a record read from a file that is not mapped
+	size_t r_payload_size;			// also the largest record that is accepted
+} nviz_reader;
+
+typedef struct {
+	nviz_reader * i_reader;
+	int64_t i_index;			// the frame i_frame holds, -1 before the first
+	const char * i_frame;
+} nviz_iter;
+
+typedef struct {
+	int w_fd;
+	nviz_header w_header;
+	int w_seekable;				// a regular file, its frame count can be filled in when it is finished
+	int64_t w_frames;			// frames written through nviz_write_frame
+	char * w_buf;				// frames not written out yet
+	size_t w_buf_len;
+	size_t w_buf_size;			// 0 writes each frame straight out
+
+	// delta files
+	off_t w_offset;				// where the next record goes
+	char * w_prev;				// the frame before, deltas are coded against it
+	int w_shift;				// the row shift of the last delta, tried first on the next one
+	int w_key_interval;			// a keyframe every this many frames
+	unsigned char * w_record;		// the record being coded
+	int64_t * w_keys;			// frame index and offset pairs of every keyframe, written out as the index
+	int64_t w_key_count;
+	int64_t w_key_size;
+} nviz_writer;
+
+typedef struct {
+	int f_col;
+	int f_row;
+	char * f_cells;				// CH_BYTS * f_col * f_row, color then character
+} nframe;
+
+typedef struct {
+	int ar_fd;
+	off_t ar_file_size;
+	char * ar_map;				// whole file mapping, NULL when frames are read instead
+	size_t ar_map_size;
+	int64_t ar_frames;
+	off_t ar_index_offset;			// the 64 bit offset of every frame, in frame order
+} nframes_reader;
+
+typedef struct {
+	int aw_fd;
+	off_t aw_offset;			// where the next frame goes
+	int64_t aw_frames;
+	char * aw_buf;				// frames not written out yet, they start at aw_offset - aw_buf_len
+	size_t aw_buf_len;
+	size_t aw_buf_size;
+	char * aw_frame;			// the frame being added, its header and cells together
+	char * aw_compare;			// a stored frame read back to compare against
+	int64_t * aw_index;			// the offset of every frame, frames with the same cells share one
+	int64_t aw_index_size;
+	uint64_t * aw_hashes;			// open addressing table of the stored frames
+	int64_t * aw_hash_offsets;		// -1 for an empty slot
+	int64_t aw_hash_size;			// a power of 2, kept at most half full
+	int64_t aw_stored;			// frames stored, the rest point at one of these
+} nframes_writer;
+
+// headers
+size_t nviz_header_size(const unsigned char * header);
+int nviz_parse_header(const unsigned char * header, nviz_header * h);
+void nviz_make_header(unsigned char * header, int version, int col, int row, int fps, int64_t frames);
+off_t nviz_frame_offset(const nviz_header * h, int64_t frame_index);
+
+// low level io, both return 1 if len bytes could not be moved
+int nviz_write_all(int fd, const char * buf, size_t len);
+int nviz_write_at(int fd, const char * buf, size_t len, off_t off);
+
+// reader
+int nviz_open(nviz_reader * r, const char * path);
+void nviz_close(nviz_reader * r);
+int nviz_read_at(nviz_reader * r, char * buf, size_t len, off_t off);
+int nviz_read_frame(nviz_reader * r, int64_t frame_index, char * frame);
+const char * nviz_frame(nviz_reader * r, int64_t frame_index);
+void nviz_iter_init(nviz_iter * it, nviz_reader * r);
+int nviz_iter_next(nviz_iter * it);
+
+// writer
+int nviz_create(nviz_writer * w, const char * path, int version, int col, int row, int fps, int64_t frames, size_t buffer_bytes);
+int nviz_create_fd(nviz_writer * w, int fd, int version, int col, int row, int fps, int64_t frames, size_t buffer_bytes);
+int nviz_write_frame(nviz_writer * w, const char * frame);
+int nviz_write_frames_at(nviz_writer * w, int64_t frame_index, const char * frames, int64_t count);
+int nviz_flush(nviz_writer * w);
+int nviz_finish(nviz_writer * w);
+
+// nframe
+int nframe_read(nframe * f, const char * path);
+int nframe_write(const char * path, int col, int row, const char * cells);
+void nframe_free(nframe * f);
+
+// nframe archives, every frame of a .nviz in one .nframes file
+int nframes_open(nframes_reader * a, const char * path);
+void nframes_close(nframes_reader * a);
+int nframes_read(nframes_reader * a, int64_t frame_index, nframe * f);
+int nframes_create(nframes_writer * a, const char * path);
+int nframes_write_frame(nframes_writer * a, int col, int row, const char * cells);
+int nframes_finish(nframes_writer * a);
+
+#endif
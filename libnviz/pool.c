@@ -0,0 +1,173 @@
+// libnviz pool - hands the frames of a .nviz to worker threads through a ring of slots, in frame order
+// made by Nikola Whallon (https://github.com/nikolawhallon/nviz-project, nikola.whallon@gmail.com)
+
+#define _FILE_OFFSET_BITS 64
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "pool.h"
+
+//----------------------------------------------------				// WORKERS
+
+// the next filled slot for a worker, NULL when the reader is done and every slot was taken, or the pool failed
+nviz_pool_slot * nviz_pool_take(nviz_pool * p)
+{
+	nviz_pool_slot * slot = NULL;
+
+	pthread_mutex_lock(&p->p_lock);
+
+	while (p->p_taken == p->p_filled && !p->p_done && !p->p_failed)
+	{
+		pthread_cond_wait(&p->p_slot_filled, &p->p_lock);
+	}
+
+	if (p->p_taken < p->p_filled && !p->p_failed)
+	{
+		slot = &p->p_slots[p->p_taken++ % p->p_slot_count];
+	}
+
+	pthread_mutex_unlock(&p->p_lock);
+
+	return slot;
+}
+
+// hand a slot back to the reader, its frame must not be used after this
+void nviz_pool_release(nviz_pool * p, nviz_pool_slot * slot)
+{
+	pthread_mutex_lock(&p->p_lock);
+	slot->s_busy = 0;
+	pthread_cond_signal(&p->p_slot_freed);
+	pthread_mutex_unlock(&p->p_lock);
+}
+
+// stop the reader and every worker, returns 1 for the first failure only, so it is reported once
+int nviz_pool_fail(nviz_pool * p)
+{
+	pthread_mutex_lock(&p->p_lock);
+
+	int first = !p->p_failed;
+
+	p->p_failed = 1;
+	pthread_cond_broadcast(&p->p_slot_filled);
+	pthread_cond_broadcast(&p->p_slot_freed);
+
+	pthread_mutex_unlock(&p->p_lock);
+
+	return first;
+}
+
+//----------------------------------------------------				// READER
+
+// read frames first_frame to last_frame of r once, in order, to the end when last_frame is negative, and hand them to
+// threads running worker(p), raw frames of a mapping without a copy, returns 1 if a worker failed or a frame could not be read
+// p_filled is the number of frames that were handed out
+int nviz_pool_run(nviz_pool * p, nviz_reader * r, int threads, void * (* worker)(void *), int64_t first_frame, int64_t last_frame)
+{
+	memset(p, 0, sizeof(nviz_pool));
+
+	p->p_reader = r;
+	p->p_unread_frame = -1;
+	pthread_mutex_init(&p->p_lock, NULL);
+	pthread_cond_init(&p->p_slot_filled, NULL);
+	pthread_cond_init(&p->p_slot_freed, NULL);
+
+	size_t frame_bytes = r->r_header.h_frame_bytes;
+	p->p_slot_count = threads * NVIZ_POOL_SLOTS_PER_WORKER;
+	p->p_slots = calloc(p->p_slot_count, sizeof(nviz_pool_slot));
+
+	int s;
+	for (s = 0; s < p->p_slot_count; s++)
+	{
+		p->p_slots[s].s_copy = r->r_in_place ? NULL : malloc(frame_bytes);
+	}
+
+	pthread_t * ids = malloc(threads * sizeof(pthread_t));
+
+	int t;
+	for (t = 0; t < threads; t++)
+	{
+		pthread_create(&ids[t], NULL, worker, p);
+	}
+
+	int64_t frame_index;
+	for (frame_index = first_frame; last_frame < 0 || frame_index <= last_frame; frame_index++)
+	{
+		const char * frame = nviz_frame(r, frame_index);
+
+		// past the end of the file, or the end of a live stream, anything else is a frame that could not be read
+		if (frame == NULL)
+		{
+			if (frame_index >= 0 && r->r_frames > 0 && frame_index < r->r_frames)
+			{
+				p->p_unread_frame = frame_index;
+				nviz_pool_fail(p);
+			}
+
+			break;
+		}
+
+		nviz_pool_slot * slot = &p->p_slots[p->p_filled % p->p_slot_count];
+
+		pthread_mutex_lock(&p->p_lock);
+
+		while (slot->s_busy && !p->p_failed)
+		{
+			pthread_cond_wait(&p->p_slot_freed, &p->p_lock);
+		}
+
+		int stop = p->p_failed;
+
+		pthread_mutex_unlock(&p->p_lock);
+
+		if (stop)
+		{
+			break;
+		}
+
+		// no worker touches a slot that is not busy
+		slot->s_index = frame_index;
+
+		if (slot->s_copy != NULL)
+		{
+			memcpy(slot->s_copy, frame, frame_bytes);
+			slot->s_frame = slot->s_copy;
+		}
+		else
+		{
+			slot->s_frame = frame;
+		}
+
+		pthread_mutex_lock(&p->p_lock);
+		slot->s_busy = 1;
+		p->p_filled++;
+		pthread_cond_signal(&p->p_slot_filled);
+		pthread_mutex_unlock(&p->p_lock);
+	}
+
+	pthread_mutex_lock(&p->p_lock);
+	p->p_done = 1;
+	pthread_cond_broadcast(&p->p_slot_filled);
+	pthread_mutex_unlock(&p->p_lock);
+
+	for (t = 0; t < threads; t++)
+	{
+		pthread_join(ids[t], NULL);
+	}
+
+	for (s = 0; s < p->p_slot_count; s++)
+	{
+		free(p->p_slots[s].s_copy);
+	}
+
+	free(p->p_slots);
+	free(ids);
+
+	pthread_mutex_destroy(&p->p_lock);
+	pthread_cond_destroy(&p->p_slot_filled);
+	pthread_cond_destroy(&p->p_slot_freed);
+
+	return p->p_failed;
+}
@@ -0,0 +1,40 @@
+// libnviz pool - hands the frames of a .nviz to worker threads through a ring of slots, in frame order
+// made by Nikola Whallon (https://github.com/nikolawhallon/nviz-project, nikola.whallon@gmail.com)
+
+#ifndef POOL_H
+#define POOL_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "nviz.h"
+
+#define NVIZ_POOL_SLOTS_PER_WORKER 4		// frames each worker can have queued up
+
+typedef struct {
+	int64_t s_index;			// the frame in the slot
+	const char * s_frame;			// in the mapping, or s_copy when the reader reuses its frame
+	char * s_copy;
+	int s_busy;				// queued or being worked on, the reader waits before it refills the slot
+} nviz_pool_slot;
+
+typedef struct {
+	nviz_reader * p_reader;
+	nviz_pool_slot * p_slots;
+	int p_slot_count;
+	int64_t p_filled;			// slots filled by the reader
+	int64_t p_taken;			// slots taken by a worker
+	int p_done;				// the reader has no more frames
+	int p_failed;				// a worker failed, or a frame could not be read, everything stops
+	int64_t p_unread_frame;			// the frame that could not be read, -1 if none
+	pthread_mutex_t p_lock;
+	pthread_cond_t p_slot_filled;
+	pthread_cond_t p_slot_freed;
+} nviz_pool;
+
+int nviz_pool_run(nviz_pool * p, nviz_reader * r, int threads, void * (* worker)(void *), int64_t first_frame, int64_t last_frame);
+nviz_pool_slot * nviz_pool_take(nviz_pool * p);
+void nviz_pool_release(nviz_pool * p, nviz_pool_slot * slot);
+int nviz_pool_fail(nviz_pool * p);
+
+#endif
@@ -1,284 +1,445 @@
 // nframe-to-bmp - a simple program that converts .nframe ascii art files to .bmp image files
 // made by Nikola Whallon (https://github.com/nikolawhallon/nviz-project, nikola.whallon@gmail.com)
 
+#define _FILE_OFFSET_BITS 64
+
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
 
-#define NFRM_HD 2
-#define CH_BYTS 2
-#define MAX_COL 250
-#define MAX_ROW 75
+#include "nviz.h"
+#include "pool.h"
 
 #define CURSOR_W 8
 #define CURSOR_H 16
 
-typedef struct {
-	uint8_t pxl[CURSOR_W * CURSOR_H];
-} character;
+#define BMP_HD 54				// the file header and the information header
+#define GLYPHS 94				// '!' to '~', a space and anything else is blank
+#define PALETTE_COLORS 8
 
 //----------------------------------------------------				// GLOBAL VARIABLES
 
-// defines the pixels of characters
-character g_character_array[94];
+// an 8 x 16 font, a byte per pixel row, the high bit is the left pixel
+const uint8_t g_font[GLYPHS][CURSOR_H] =
+{
+	{ 0x00, 0x00, 0x00, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x00, 0x18, 0x18, 0x00, 0x00, 0x00, 0x00 },	// !
+	{ 0x00, 0x00, 0x6c, 0x6c, 0x6c, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },	// "
+	{ 0x00, 0x00, 0x00, 0x00, 0x6c, 0x6c, 0xfe, 0x6c, 0x6c, 0xfe, 0x6c, 0x6c, 0x00, 0x00, 0x00, 0x00 },	// #
+	{ 0x00, 0x00, 0x18, 0x7c, 0xc6, 0xc0, 0x7c, 0x06, 0x06, 0xc6, 0x7c, 0x18, 0x18, 0x00, 0x00, 0x00 },	// $
+	{ 0x00, 0x00, 0x00, 0x00, 0xc4, 0xcc, 0x18, 0x30, 0x60, 0xcc, 0x8c, 0x00, 0x00, 0x00, 0x00, 0x00 },	// %
+	{ 0x00, 0x00, 0x38, 0x6c, 0x6c, 0x38, 0x76, 0xdc, 0xcc, 0xcc, 0xcc, 0x76, 0x00, 0x00, 0x00, 0x00 },	// &
+	{ 0x00, 0x00, 0x30, 0x30, 0x60, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },	// '
+	{ 0x00, 0x00, 0x0c, 0x18, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x18, 0x0c, 0x00, 0x00, 0x00, 0x00 },	// (
+	{ 0x00, 0x00, 0x60, 0x30, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x30, 0x60, 0x00, 0x00, 0x00, 0x00 },	// )
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x6c, 0x38, 0xfe, 0x38, 0x6c, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },	// *
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x30, 0x30, 0xfc, 0x30, 0x30, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },	// +
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x30, 0x30, 0x60, 0x00, 0x00, 0x00 },	// ,
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xfe, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },	// -
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x30, 0x30, 0x00, 0x00, 0x00, 0x00 },	// .
+	{ 0x00, 0x00, 0x06, 0x0c, 0x0c, 0x18, 0x18, 0x30, 0x30, 0x60, 0x60, 0xc0, 0x00, 0x00, 0x00, 0x00 },	// /
+	{ 0x00, 0x00, 0x7c, 0xc6, 0xc6, 0xce, 0xde, 0xf6, 0xe6, 0xc6, 0xc6, 0x7c, 0x00, 0x00, 0x00, 0x00 },	// 0
+	{ 0x00, 0x00, 0x18, 0x38, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x7e, 0x00, 0x00, 0x00, 0x00 },	// 1
+	{ 0x00, 0x00, 0x7c, 0xc6, 0x06, 0x0c, 0x18, 0x30, 0x60, 0xc0, 0xc6, 0xfe, 0x00, 0x00, 0x00, 0x00 },	// 2
+	{ 0x00, 0x00, 0x7c, 0xc6, 0x06, 0x06, 0x3c, 0x06, 0x06, 0x06, 0xc6, 0x7c, 0x00, 0x00, 0x00, 0x00 },	// 3
+	{ 0x00, 0x00, 0x0c, 0x1c, 0x3c, 0x6c, 0xcc, 0xfe, 0x0c, 0x0c, 0x0c, 0x1e, 0x00, 0x00, 0x00, 0x00 },	// 4
+	{ 0x00, 0x00, 0xfe, 0xc0, 0xc0, 0xc0, 0xfc, 0x06, 0x06, 0x06, 0xc6, 0x7c, 0x00, 0x00, 0x00, 0x00 },	// 5
+	{ 0x00, 0x00, 0x38, 0x60, 0xc0, 0xc0, 0xfc, 0xc6, 0xc6, 0xc6, 0xc6, 0x7c, 0x00, 0x00, 0x00, 0x00 },	// 6
+	{ 0x00, 0x00, 0xfe, 0xc6, 0x06, 0x0c, 0x18, 0x30, 0x30, 0x30, 0x30, 0x30, 0x00, 0x00, 0x00, 0x00 },	// 7
+	{ 0x00, 0x00, 0x7c, 0xc6, 0xc6, 0xc6, 0x7c, 0xc6, 0xc6, 0xc6, 0xc6, 0x7c, 0x00, 0x00, 0x00, 0x00 },	// 8
+	{ 0x00, 0x00, 0x7c, 0xc6, 0xc6, 0xc6, 0x7e, 0x06, 0x06, 0x06, 0x0c, 0x78, 0x00, 0x00, 0x00, 0x00 },	// 9
+	{ 0x00, 0x00, 0x00, 0x00, 0x30, 0x30, 0x00, 0x00, 0x00, 0x30, 0x30, 0x00, 0x00, 0x00, 0x00, 0x00 },	// :
+	{ 0x00, 0x00, 0x00, 0x00, 0x30, 0x30, 0x00, 0x00, 0x00, 0x30, 0x30, 0x60, 0x00, 0x00, 0x00, 0x00 },	// ;
+	{ 0x00, 0x00, 0x00, 0x0c, 0x18, 0x30, 0x60, 0xc0, 0x60, 0x30, 0x18, 0x0c, 0x00, 0x00, 0x00, 0x00 },	// <
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0xfe, 0x00, 0x00, 0xfe, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },	// =
+	{ 0x00, 0x00, 0x00, 0x60, 0x30, 0x18, 0x0c, 0x06, 0x0c, 0x18, 0x30, 0x60, 0x00, 0x00, 0x00, 0x00 },	// >
+	{ 0x00, 0x00, 0x7c, 0xc6, 0xc6, 0x0c, 0x18, 0x18, 0x18, 0x00, 0x18, 0x18, 0x00, 0x00, 0x00, 0x00 },	// ?
+	{ 0x00, 0x00, 0x7c, 0xc6, 0xc6, 0xde, 0xde, 0xde, 0xdc, 0xc0, 0xc0, 0x7c, 0x00, 0x00, 0x00, 0x00 },	// @
+	{ 0x00, 0x00, 0x38, 0x6c, 0xc6, 0xc6, 0xc6, 0xfe, 0xc6, 0xc6, 0xc6, 0xc6, 0x00, 0x00, 0x00, 0x00 },	// A
+	{ 0x00, 0x00, 0xfc, 0xc6, 0xc6, 0xc6, 0xfc, 0xc6, 0xc6, 0xc6, 0xc6, 0xfc, 0x00, 0x00, 0x00, 0x00 },	// B
+	{ 0x00, 0x00, 0x7c, 0xc6, 0xc0, 0xc0, 0xc0, 0xc0, 0xc0, 0xc0, 0xc6, 0x7c, 0x00, 0x00, 0x00, 0x00 },	// C
+	{ 0x00, 0x00, 0xf8, 0xcc, 0xc6, 0xc6, 0xc6, 0xc6, 0xc6, 0xc6, 0xcc, 0xf8, 0x00, 0x00, 0x00, 0x00 },	// D
+	{ 0x00, 0x00, 0xfe, 0xc0, 0xc0, 0xc0, 0xfc, 0xc0, 0xc0, 0xc0, 0xc0, 0xfe, 0x00, 0x00, 0x00, 0x00 },	// E
+	{ 0x00, 0x00, 0xfe, 0xc0, 0xc0, 0xc0, 0xfc, 0xc0, 0xc0, 0xc0, 0xc0, 0xc0, 0x00, 0x00, 0x00, 0x00 },	// F
+	{ 0x00, 0x00, 0x7c, 0xc6, 0xc0, 0xc0, 0xc0, 0xce, 0xc6, 0xc6, 0xc6, 0x7c, 0x00, 0x00, 0x00, 0x00 },	// G
+	{ 0x00, 0x00, 0xc6, 0xc6, 0xc6, 0xc6, 0xfe, 0xc6, 0xc6, 0xc6, 0xc6, 0xc6, 0x00, 0x00, 0x00, 0x00 },	// H
+	{ 0x00, 0x00, 0x78, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x78, 0x00, 0x00, 0x00, 0x00 },	// I
+	{ 0x00, 0x00, 0x1e, 0x0c, 0x0c, 0x0c, 0x0c, 0x0c, 0xcc, 0xcc, 0xcc, 0x78, 0x00, 0x00, 0x00, 0x00 },	// J
+	{ 0x00, 0x00, 0xc6, 0xcc, 0xd8, 0xf0, 0xe0, 0xf0, 0xd8, 0xcc, 0xc6, 0xc6, 0x00, 0x00, 0x00, 0x00 },	// K
+	{ 0x00, 0x00, 0xc0, 0xc0, 0xc0, 0xc0, 0xc0, 0xc0, 0xc0, 0xc0, 0xc0, 0xfe, 0x00, 0x00, 0x00, 0x00 },	// L
+	{ 0x00, 0x00, 0xc6, 0xee, 0xfe, 0xd6, 0xc6, 0xc6, 0xc6, 0xc6, 0xc6, 0xc6, 0x00, 0x00, 0x00, 0x00 },	// M
+	{ 0x00, 0x00, 0xc6, 0xe6, 0xf6, 0xde, 0xce, 0xc6, 0xc6, 0xc6, 0xc6, 0xc6, 0x00, 0x00, 0x00, 0x00 },	// N
+	{ 0x00, 0x00, 0x7c, 0xc6, 0xc6, 0xc6, 0xc6, 0xc6, 0xc6, 0xc6, 0xc6, 0x7c, 0x00, 0x00, 0x00, 0x00 },	// O
+	{ 0x00, 0x00, 0xfc, 0xc6, 0xc6, 0xc6, 0xfc, 0xc0, 0xc0, 0xc0, 0xc0, 0xc0, 0x00, 0x00, 0x00, 0x00 },	// P
+	{ 0x00, 0x00, 0x7c, 0xc6, 0xc6, 0xc6, 0xc6, 0xc6, 0xd6, 0xde, 0x7c, 0x06, 0x00, 0x00, 0x00, 0x00 },	// Q
+	{ 0x00, 0x00, 0xfc, 0xc6, 0xc6, 0xc6, 0xfc, 0xd8, 0xcc, 0xc6, 0xc6, 0xc6, 0x00, 0x00, 0x00, 0x00 },	// R
+	{ 0x00, 0x00, 0x7c, 0xc6, 0xc0, 0xc0, 0x7c, 0x06, 0x06, 0x06, 0xc6, 0x7c, 0x00, 0x00, 0x00, 0x00 },	// S
+	{ 0x00, 0x00, 0xfc, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x00, 0x00, 0x00, 0x00 },	// T
+	{ 0x00, 0x00, 0xc6, 0xc6, 0xc6, 0xc6, 0xc6, 0xc6, 0xc6, 0xc6, 0xc6, 0x7c, 0x00, 0x00, 0x00, 0x00 },	// U
+	{ 0x00, 0x00, 0xc6, 0xc6, 0xc6, 0xc6, 0xc6, 0xc6, 0xc6, 0x6c, 0x38, 0x10, 0x00, 0x00, 0x00, 0x00 },	// V
+	{ 0x00, 0x00, 0xc6, 0xc6, 0xc6, 0xc6, 0xc6, 0xd6, 0xd6, 0xfe, 0xee, 0xc6, 0x00, 0x00, 0x00, 0x00 },	// W
+	{ 0x00, 0x00, 0xc6, 0xc6, 0x6c, 0x38, 0x10, 0x10, 0x38, 0x6c, 0xc6, 0xc6, 0x00, 0x00, 0x00, 0x00 },	// X
+	{ 0x00, 0x00, 0xc6, 0xc6, 0xc6, 0x6c, 0x38, 0x38, 0x38, 0x38, 0x38, 0x38, 0x00, 0x00, 0x00, 0x00 },	// Y
+	{ 0x00, 0x00, 0xfe, 0x06, 0x06, 0x0c, 0x18, 0x30, 0x60, 0xc0, 0xc0, 0xfe, 0x00, 0x00, 0x00, 0x00 },	// Z
+	{ 0x00, 0x00, 0x78, 0x60, 0x60, 0x60, 0x60, 0x60, 0x60, 0x60, 0x60, 0x78, 0x00, 0x00, 0x00, 0x00 },	// [
+	{ 0x00, 0x00, 0xc0, 0x60, 0x60, 0x30, 0x30, 0x18, 0x18, 0x0c, 0x0c, 0x06, 0x00, 0x00, 0x00, 0x00 },	// backslash
+	{ 0x00, 0x00, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x78, 0x00, 0x00, 0x00, 0x00 },	// ]
+	{ 0x00, 0x00, 0x10, 0x38, 0x6c, 0xc6, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },	// ^
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0x00 },	// _
+	{ 0x00, 0x00, 0x30, 0x18, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },	// `
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x7c, 0x06, 0x7e, 0xc6, 0xc6, 0xc6, 0x7e, 0x00, 0x00, 0x00, 0x00 },	// a
+	{ 0x00, 0x00, 0xc0, 0xc0, 0xc0, 0xfc, 0xc6, 0xc6, 0xc6, 0xc6, 0xc6, 0xfc, 0x00, 0x00, 0x00, 0x00 },	// b
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x7c, 0xc6, 0xc0, 0xc0, 0xc0, 0xc6, 0x7c, 0x00, 0x00, 0x00, 0x00 },	// c
+	{ 0x00, 0x00, 0x06, 0x06, 0x06, 0x7e, 0xc6, 0xc6, 0xc6, 0xc6, 0xc6, 0x7e, 0x00, 0x00, 0x00, 0x00 },	// d
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x7c, 0xc6, 0xc6, 0xfe, 0xc0, 0xc6, 0x7c, 0x00, 0x00, 0x00, 0x00 },	// e
+	{ 0x00, 0x00, 0x1c, 0x36, 0x30, 0xfc, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x00, 0x00, 0x00, 0x00 },	// f
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x7e, 0xc6, 0xc6, 0xc6, 0xc6, 0xc6, 0x7e, 0x06, 0xc6, 0x7c, 0x00 },	// g
+	{ 0x00, 0x00, 0xc0, 0xc0, 0xc0, 0xfc, 0xc6, 0xc6, 0xc6, 0xc6, 0xc6, 0xc6, 0x00, 0x00, 0x00, 0x00 },	// h
+	{ 0x00, 0x00, 0x00, 0x30, 0x00, 0xf0, 0x30, 0x30, 0x30, 0x30, 0x30, 0xfc, 0x00, 0x00, 0x00, 0x00 },	// i
+	{ 0x00, 0x00, 0x00, 0x06, 0x00, 0x0e, 0x06, 0x06, 0x06, 0x06, 0x06, 0x06, 0x06, 0xc6, 0x7c, 0x00 },	// j
+	{ 0x00, 0x00, 0xc0, 0xc0, 0xc0, 0xc6, 0xcc, 0xd8, 0xf0, 0xd8, 0xcc, 0xc6, 0x00, 0x00, 0x00, 0x00 },	// k
+	{ 0x00, 0x00, 0x70, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x78, 0x00, 0x00, 0x00, 0x00 },	// l
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0xec, 0xfe, 0xd6, 0xd6, 0xd6, 0xd6, 0xc6, 0x00, 0x00, 0x00, 0x00 },	// m
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0xfc, 0xc6, 0xc6, 0xc6, 0xc6, 0xc6, 0xc6, 0x00, 0x00, 0x00, 0x00 },	// n
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x7c, 0xc6, 0xc6, 0xc6, 0xc6, 0xc6, 0x7c, 0x00, 0x00, 0x00, 0x00 },	// o
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0xfc, 0xc6, 0xc6, 0xc6, 0xc6, 0xc6, 0xfc, 0xc0, 0xc0, 0xc0, 0x00 },	// p
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x7e, 0xc6, 0xc6, 0xc6, 0xc6, 0xc6, 0x7e, 0x06, 0x06, 0x06, 0x00 },	// q
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0xdc, 0xf6, 0xe0, 0xc0, 0xc0, 0xc0, 0xc0, 0x00, 0x00, 0x00, 0x00 },	// r
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x7c, 0xc6, 0x60, 0x38, 0x0c, 0xc6, 0x7c, 0x00, 0x00, 0x00, 0x00 },	// s
+	{ 0x00, 0x00, 0x00, 0x30, 0x30, 0xfc, 0x30, 0x30, 0x30, 0x30, 0x30, 0x1e, 0x00, 0x00, 0x00, 0x00 },	// t
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0xc6, 0xc6, 0xc6, 0xc6, 0xc6, 0xc6, 0x7e, 0x00, 0x00, 0x00, 0x00 },	// u
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0xc6, 0xc6, 0xc6, 0xc6, 0x6c, 0x38, 0x10, 0x00, 0x00, 0x00, 0x00 },	// v
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0xc6, 0xc6, 0xd6, 0xd6, 0xd6, 0xfe, 0x6c, 0x00, 0x00, 0x00, 0x00 },	// w
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0xc6, 0x6c, 0x38, 0x10, 0x38, 0x6c, 0xc6, 0x00, 0x00, 0x00, 0x00 },	// x
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0xc6, 0xc6, 0xc6, 0xc6, 0xc6, 0xc6, 0x7e, 0x06, 0x0c, 0xf8, 0x00 },	// y
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0xfe, 0x0c, 0x18, 0x30, 0x60, 0xc0, 0xfe, 0x00, 0x00, 0x00, 0x00 },	// z
+	{ 0x00, 0x00, 0x1c, 0x30, 0x30, 0x30, 0xe0, 0x30, 0x30, 0x30, 0x30, 0x1c, 0x00, 0x00, 0x00, 0x00 },	// {
+	{ 0x00, 0x00, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x00, 0x00 },	// |
+	{ 0x00, 0x00, 0x70, 0x18, 0x18, 0x18, 0x0e, 0x18, 0x18, 0x18, 0x18, 0x70, 0x00, 0x00, 0x00, 0x00 },	// }
+	{ 0x00, 0x00, 0x76, 0xdc, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },	// ~
+};
+
+// the colors of a cell, blue, green, red as a bmp stores them, 0 and anything past 7 are black
+const uint8_t g_palette[PALETTE_COLORS][3] =
+{
+	{ 0, 0, 0 },
+	{ 255, 0, 0 },
+	{ 0, 255, 0 },
+	{ 255, 255, 0 },
+	{ 0, 0, 255 },
+	{ 255, 0, 255 },
+	{ 0, 255, 255 },
+	{ 255, 255, 255 }
+};
+
+// every glyph row expanded to CURSOR_W pixels of every color, a row of a cell is one copy
+uint8_t g_glyph_rows[PALETTE_COLORS][256][CURSOR_W * 3];
 
 // nframe
 char g_nframe_file_path[256];
-char g_frame[CH_BYTS * (MAX_COL * MAX_ROW)];
-int g_nframe_col;
-int g_nframe_row;
+nframe g_nframe;
 
 // bmp
 char g_bmp_file_path[256];
-int32_t g_px_w;
-int32_t g_px_h;
+
+// batch, every frame of a .nviz is drawn by a pool of workers that share the glyph rows and the mapping
+nviz_reader g_nviz;
+int g_threads;					// 0 means one per cpu
 
 //----------------------------------------------------				// FUNCTIONS
 
-// initialize the pixel definitions of 94 ascii characters
-void init_characters()
+// expand every possible glyph row against every palette color
+void init_glyph_rows()
 {
-	// set the character array pixels to 0
-	int i;
-	int j;
-	for (i = 0; i < 94; i++)
+	int clr;
+	int bits;
+	int w;
+	for (clr = 0; clr < PALETTE_COLORS; clr++)
 	{
-		for (j = 0; j < CURSOR_W * CURSOR_H; j++)
+		for (bits = 0; bits < 256; bits++)
 		{
-			g_character_array[i].pxl[j] = 0;
+			for (w = 0; w < CURSOR_W; w++)
+			{
+				const uint8_t * bgr = bits & (0x80 >> w) ? g_palette[clr] : g_palette[0];
+
+				memcpy(&g_glyph_rows[clr][bits][3 * w], bgr, 3);
+			}
 		}
 	}
+}
 
-	// TO-DO - more elegant initialization
-	g_character_array[1].pxl[27] = 1;
-	g_character_array[1].pxl[28] = 1;
-	g_character_array[1].pxl[35] = 1;
-	g_character_array[1].pxl[36] = 1;
-	g_character_array[1].pxl[43] = 1;
-	g_character_array[1].pxl[44] = 1;
-	g_character_array[1].pxl[51] = 1;
-	g_character_array[1].pxl[52] = 1;
-	g_character_array[1].pxl[59] = 1;
-	g_character_array[1].pxl[60] = 1;
-	g_character_array[1].pxl[67] = 1;
-	g_character_array[1].pxl[68] = 1;
-
-	g_character_array[1].pxl[83] = 1;
-	g_character_array[1].pxl[84] = 1;
-	g_character_array[1].pxl[91] = 1;
-	g_character_array[1].pxl[92] = 1;
-
-	// TO-DO - initialize all other characters as well
+// the pixel row h, counted from the top, of the glyph of chr
+static inline uint8_t glyph_row(char chr, int h)
+{
+	return chr > ' ' && chr <= '~' ? g_font[chr - '!'][h] : 0;
 }
 
-// initialize frame
-int init_frame()
+static void put_u16(uint8_t * bytes, uint16_t value)
 {
-	// declare and open the nframe file
-	FILE * nframe_file = fopen(g_nframe_file_path, "rb");
+	bytes[0] = value;
+	bytes[1] = value >> 8;
+}
 
-	// check that the file could be opened
-	if (nframe_file == NULL)
+static void put_u32(uint8_t * bytes, uint32_t value)
+{
+	put_u16(bytes, value);
+	put_u16(bytes + 2, value >> 16);
+}
+
+// bytes in a pixel row of a bmp, rows are padded to a multiple of 4
+size_t bmp_row_bytes(int col)
+{
+	return ((size_t) col * CURSOR_W * 3 + 3) & ~(size_t) 3;
+}
+
+// bytes in the whole bmp of a col x row frame, headers included
+size_t bmp_size(int col, int row)
+{
+	return BMP_HD + bmp_row_bytes(col) * row * CURSOR_H;
+}
+
+// draw a frame into a whole bmp of bmp_size bytes, headers, pixels and row padding
+void draw_bmp(uint8_t * bmp, int col, int row, const char * frame)
+{
+	int32_t px_w = col * CURSOR_W;
+	int32_t px_h = row * CURSOR_H;
+	size_t row_bytes = bmp_row_bytes(col);
+	uint32_t image_size = row_bytes * px_h;
+
+	// bitmap file header, "BM", the file size, two reserved fields and where the pixels start
+	put_u16(bmp, 0x4d42);
+	put_u32(bmp + 2, BMP_HD + image_size);
+	put_u16(bmp + 6, 8);
+	put_u16(bmp + 8, 8);
+	put_u32(bmp + 10, BMP_HD);
+
+	// bitmap information header, 24 bits per pixel and no compression
+	put_u32(bmp + 14, 40);
+	put_u32(bmp + 18, px_w);
+	put_u32(bmp + 22, px_h);
+	put_u16(bmp + 26, 1);
+	put_u16(bmp + 28, 24);
+	put_u32(bmp + 30, 0);
+	put_u32(bmp + 34, image_size);
+	put_u32(bmp + 38, px_w);
+	put_u32(bmp + 42, px_h);
+	put_u32(bmp + 46, 0);
+	put_u32(bmp + 50, 0);
+
+	// bmp pixel array, bottom row first
+	uint8_t * line = bmp + BMP_HD;
+
+	int c;
+	int r;
+	int h;
+	for (r = row - 1; r >= 0; r--)
 	{
-		return 1;
+		const char * cells = frame + CH_BYTS * r * col;
+
+		for (h = CURSOR_H - 1; h >= 0; h--)
+		{
+			for (c = 0; c < col; c++)
+			{
+				uint8_t clr = cells[CH_BYTS * c];
+
+				if (clr >= PALETTE_COLORS)
+				{
+					clr = 0;
+				}
+
+				memcpy(line + c * CURSOR_W * 3, g_glyph_rows[clr][glyph_row(cells[CH_BYTS * c + 1], h)], CURSOR_W * 3);
+			}
+
+			memset(line + (size_t) px_w * 3, 0, row_bytes - (size_t) px_w * 3);
+			line += row_bytes;
+		}
 	}
+}
 
-        // calculate the file size
-	fseek(nframe_file, 0, SEEK_END);
-	int file_size = ftell(nframe_file);
-	fseek(nframe_file, 0, SEEK_SET);
+// write a whole bmp with one open, write and close, returns 1 if it could not be written
+int write_bmp(const char * path, const uint8_t * bmp, size_t size)
+{
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
 
-	// check that the file contains the nframe info
-	if (file_size < NFRM_HD)
+	if (fd < 0)
 	{
-		fclose(nframe_file);
 		return 1;
 	}
 
-	// input the nframe info
-	fread(&g_nframe_col, 1, 1, nframe_file);
-	fread(&g_nframe_row, 1, 1, nframe_file);
+	int failed = nviz_write_all(fd, (const char *) bmp, size);
 
-	// check that the file contains the nframe data
-	if (file_size < NFRM_HD + CH_BYTS * (g_nframe_col * g_nframe_row))
+	if (close(fd))
 	{
-		fclose(nframe_file);
-		return 1;
+		failed = 1;
 	}
 
-	// input the nframe data
-	fread(&g_frame, 1, CH_BYTS * (g_nframe_col * g_nframe_row), nframe_file);
+	return failed;
+}
+
+// worker thread, draws the frames the pool hands it into its own bmp and writes them out
+void * convert_frames(void * arg)
+{
+	nviz_pool * pool = arg;
+	nviz_pool_slot * slot;
+
+	int col = g_nviz.r_header.h_col;
+	int row = g_nviz.r_header.h_row;
+	size_t size = bmp_size(col, row);
+	uint8_t * bmp = malloc(size);
+
+	while ((slot = nviz_pool_take(pool)) != NULL)
+	{
+		// the slot is handed back as soon as the frame is drawn, before the file is written
+		int64_t frame_index = slot->s_index;
+
+		draw_bmp(bmp, col, row, slot->s_frame);
+
+		nviz_pool_release(pool, slot);
 
-	// close the nframe file
-	fclose(nframe_file);
+		// room for the whole base path, the frame number and the extension
+		char bmp_file_path[512];
+		snprintf(bmp_file_path, sizeof(bmp_file_path), "%s%lld.bmp", g_bmp_file_path, (long long) frame_index);
 
-	return 0;
+		if (write_bmp(bmp_file_path, bmp, size) && nviz_pool_fail(pool))
+		{
+			fprintf(stderr, "ERROR - could not write %s\n", bmp_file_path);
+		}
+	}
+
+	free(bmp);
+
+	return NULL;
+}
+
+// convert frames first_frame to last_frame of g_nviz, to the end when last_frame is negative, returns 1 if any could not be
+// the .nviz is read once, in order, and the frames are handed to the workers, raw frames of a mapping without a copy
+int convert_nviz(int64_t first_frame, int64_t last_frame)
+{
+	int threads = g_threads > 0 ? g_threads : sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (threads < 1)
+	{
+		threads = 1;
+	}
+
+	nviz_pool pool;
+	int failed = nviz_pool_run(&pool, &g_nviz, threads, &convert_frames, first_frame, last_frame);
+
+	if (pool.p_unread_frame >= 0)
+	{
+		fprintf(stderr, "ERROR - could not read frame %lld of %s\n", (long long) pool.p_unread_frame, g_nframe_file_path);
+	}
+
+	// a range that starts past the end converts nothing
+	if (pool.p_filled == 0)
+	{
+		fprintf(stderr, "ERROR - %s has no frame %lld\n", g_nframe_file_path, (long long) first_frame);
+		failed = 1;
+	}
+
+	return failed;
 }
 
 // main
 int main(int argc, char * argv[])
 {
+	// command line options
+	int64_t frame_index = 0;
+	int64_t last_frame_index = -1;
+	int opt;
+	while ((opt = getopt(argc, argv, "f:l:j:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'f':
+				frame_index = strtoll(optarg, NULL, 10);
+				break;
+			case 'l':
+				last_frame_index = strtoll(optarg, NULL, 10);
+				break;
+			case 'j':
+				g_threads = atoi(optarg);
+				break;
+			default:
+				argc = 0;
+				break;
+		}
+	}
+
 	// command line input
-	if (argc != 3)
+	if (argc - optind != 2)
 	{
 		fprintf(stderr, "ERROR - wrong number of arguments\n");
-		fprintf(stderr, "usage: %s in_file_path out_file_path\n", argv[0]);
+		fprintf(stderr, "usage: %s [-f frame] [-l last_frame] [-j threads] in_file_path out_file_path\n", argv[0]);
 
 		return 1;
 	}
 
+	argv += optind - 1;
+
 	sprintf(g_nframe_file_path, argv[1]);
 	sprintf(g_bmp_file_path, argv[2]);
 
-	// characters
-	init_characters();
+	// glyphs
+	init_glyph_rows();
 
-	// nframe
-	if (init_frame())
+	// nframe, an archive is read by frame number, a .nviz is converted a frame at a time, anything else is a single .nframe file
+	// a legacy .nviz header cannot be told from a .nframe, so only versioned .nviz files are converted in a batch
+	nframes_reader archive;
+	int is_archive = nframes_open(&archive, g_nframe_file_path) == 0;
+	int is_nviz = !is_archive && nviz_open(&g_nviz, g_nframe_file_path) == 0;
+	int failed;
+
+	if (is_nviz && g_nviz.r_header.h_version == 0)
+	{
+		nviz_close(&g_nviz);
+		is_nviz = 0;
+	}
+
+	if (is_nviz)
+	{
+		failed = convert_nviz(frame_index, last_frame_index);
+
+		nviz_close(&g_nviz);
+
+		return failed;
+	}
+
+	if (is_archive)
+	{
+		failed = nframes_read(&archive, frame_index, &g_nframe);
+
+		nframes_close(&archive);
+	}
+	else
+	{
+		failed = nframe_read(&g_nframe, g_nframe_file_path);
+	}
+
+	if (failed)
 	{
 		fprintf(stderr, "ERROR - could not open %s\n", g_nframe_file_path);
 
 		return 1;
 	}
 
-	// bmp
-	g_px_w = g_nframe_col * CURSOR_W;
-	g_px_h = g_nframe_row * CURSOR_H;
-
-	// bitmap file header
-	uint16_t BM = 0x4d42;
-	uint32_t file_size = 54 + g_px_w * g_px_h * 3;
-	uint16_t reserve1 = 8;
-	uint16_t reserve2 = 8;
-	uint32_t pixel_array_start = 54;
-
-	// bitmap information header
-	uint32_t bm_info_size = 40;
-	int32_t pixel_wd = g_px_w;
-	int32_t pixel_ht = g_px_h;
-	uint16_t color_planes = 1;
-	uint16_t bits_per_pixel = 24;
-	uint32_t compression = 0;
-	uint32_t image_size = g_px_w * g_px_h * 3;
-	int32_t hor_res = g_px_w;
-	int32_t ver_res = g_px_h;
-	uint32_t palette_colors = 0;
-	uint32_t important_colors = 0;
-
-	// declare and open the bmp file
-	FILE * bmp_file = fopen(g_bmp_file_path, "wb");
-
-	// write out the bitmap file header
-	fwrite(&BM, 2, 1, bmp_file);
-	fwrite(&file_size, 4, 1, bmp_file);
-	fwrite(&reserve1, 2, 1, bmp_file);
-	fwrite(&reserve2, 2, 1, bmp_file);
-	fwrite(&pixel_array_start, 4, 1, bmp_file);
-
-	// write out the bitmap information header
-	fwrite(&bm_info_size, 4, 1, bmp_file);
-	fwrite(&pixel_wd, 4, 1, bmp_file);
-	fwrite(&pixel_ht, 4, 1, bmp_file);
-	fwrite(&color_planes, 2, 1, bmp_file);
-	fwrite(&bits_per_pixel, 2, 1, bmp_file);
-	fwrite(&compression, 4, 1, bmp_file);
-	fwrite(&image_size, 4, 1, bmp_file);
-	fwrite(&hor_res, 4, 1, bmp_file);
-	fwrite(&ver_res, 4, 1, bmp_file);
-	fwrite(&palette_colors, 4, 1, bmp_file);
-	fwrite(&important_colors, 4, 1, bmp_file);
-
-	// bmp pixel array
-	char clr;
-	char chr;
-
-	uint8_t red;
-	uint8_t green;
-	uint8_t blue;
+	// bmp, built whole in memory and written at once
+	size_t size = bmp_size(g_nframe.f_col, g_nframe.f_row);
+	uint8_t * bmp = malloc(size);
 
-	int c;
-	int r;
-	int w;
-	int h;
-	for (r = 0; r < g_nframe_row; r++)
+	draw_bmp(bmp, g_nframe.f_col, g_nframe.f_row, g_nframe.f_cells);
+
+	failed = write_bmp(g_bmp_file_path, bmp, size);
+
+	if (failed)
 	{
-		for (h = 0; h < CURSOR_H; h++)
-		{
-			for (c = 0; c < g_nframe_col; c++)
-			{
-				for (w = 0; w < CURSOR_W; w++)
-				{
-					int index = CH_BYTS * ((g_nframe_row - r - 1) * g_nframe_col + c);
-
-					clr = g_frame[index];
-					chr = g_frame[index + 1];
-
-					if (g_character_array[chr - 32].pxl[(CURSOR_H - h - 1) * CURSOR_W + w])
-					{
-						switch (clr)
-						{
-							case 1:
-								red = 0;
-								green = 0;
-								blue = 255;
-								break;
-							case 2:
-								red = 0;
-								green = 255;
-								blue = 0;
-								break;
-							case 3:
-								red = 0;
-								green = 255;
-								blue = 255;
-								break;
-							case 4:
-								red = 255;
-								green = 0;
-								blue = 0;
-								break;
-							case 5:
-								red = 255;
-								green = 0;
-								blue = 255;
-								break;
-							case 6:
-								red = 255;
-								green = 255;
-								blue = 0;
-								break;
-							case 7:
-								red = 255;
-								green = 255;
-								blue = 255;
-								break;
-							default:
-								red = 0;
-								green = 0;
-								blue = 0;
-								break;
-						}
-
-						fwrite(&blue, 1, 1, bmp_file);
-						fwrite(&green, 1, 1, bmp_file);
-						fwrite(&red, 1, 1, bmp_file);
-					}
-					else
-					{
-						red = 0;
-						green = 0;
-						blue = 0;
-
-						fwrite(&blue, 1, 1, bmp_file);
-						fwrite(&green, 1, 1, bmp_file);
-						fwrite(&red, 1, 1, bmp_file);
-					}
-				}
-			}
-		}
+		fprintf(stderr, "ERROR - could not write %s\n", g_bmp_file_path);
 	}
 
-	// close the bmp file
-	fclose(bmp_file);
+	free(bmp);
+	nframe_free(&g_nframe);
 
-	return 0;
+	return failed;
 }
@@ -1,13 +1,22 @@
 // nframe-viewer - a simple ncurses program that views .nframe ascii art files
 // made by Nikola Whallon (https://github.com/nikolawhallon/nviz-project, nikola.whallon@gmail.com)
 
+#define _FILE_OFFSET_BITS 64
+
 #include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
 #include <ncurses.h>
 
-#define NFRM_HD 2
-#define CH_BYTS 2
-#define MAX_COL 250
-#define MAX_ROW 75
+#include "nviz.h"
+#include "ansi.h"
+
+#define BACKEND_NCURSES 0
+#define BACKEND_ANSI 1
+
+#define PRINTABLE(chr) ((chr) >= 32 && (chr) <= 126)
 
 //----------------------------------------------------				// GLOBAL VARIABLES
 
@@ -18,12 +27,16 @@ int g_running = 1;				// bool
 // ncurses
 int g_col, g_row;
 int g_color_mode;				// bool
+int g_backend = BACKEND_NCURSES;
 
 // nframe
 char g_nframe_file_path[256];
-char g_frame[CH_BYTS * (MAX_COL * MAX_ROW)];
-int g_nframe_col;
-int g_nframe_row;
+nframe g_nframe;
+
+// archive, the file is a .nframes archive when g_is_archive is set and g_nframe is one of its frames
+nframes_reader g_archive;
+int g_is_archive;				// bool
+int64_t g_frame_index;
 
 // panels
 int g_hide_panel = 0;				// bool
@@ -82,28 +95,165 @@ void deinit_ncurses()
 	endwin();
 }
 
+// initialize the screen with the chosen backend
+void init_screen()
+{
+	if (g_backend == BACKEND_ANSI)
+	{
+		// a read waits for the next key
+		ansi_init(1);
+
+		g_col = g_ansi_col;
+		g_row = g_ansi_row;
+		g_color_mode = 1;
+	}
+	else
+	{
+		init_ncurses();
+	}
+}
+
+// deinitialize the screen
+void deinit_screen()
+{
+	if (g_backend == BACKEND_ANSI)
+	{
+		ansi_deinit();
+	}
+	else
+	{
+		deinit_ncurses();
+	}
+}
+
+// clear the screen
+void clear_screen()
+{
+	if (g_backend == BACKEND_ANSI)
+	{
+		ansi_clear();
+	}
+	else
+	{
+		clear();
+	}
+}
+
+// put the drawn frame on the terminal
+void present_screen()
+{
+	if (g_backend == BACKEND_ANSI)
+	{
+		ansi_flush();
+	}
+	else
+	{
+		refresh();
+	}
+}
+
+// wait for the next key
+int read_key()
+{
+	if (g_backend == BACKEND_ANSI)
+	{
+		unsigned char key;
+
+		return read(STDIN_FILENO, &key, 1) == 1 ? key : ERR;
+	}
+
+	return getch();
+}
+
+// draw formatted text at r, c in the default color
+void draw_text(int r, int c, const char * format, ...)
+{
+	char text[1024];
+	va_list args;
+
+	va_start(args, format);
+	vsnprintf(text, sizeof(text), format, args);
+	va_end(args);
+
+	if (g_backend == BACKEND_NCURSES)
+	{
+		mvaddstr(r, c, text);
+
+		return;
+	}
+
+	ansi_text(r, c, text, strlen(text), 0);
+}
+
 // toggle_panel
 void toggle_panel()
 {
 	g_hide_panel ^= 1;
 }
 
+// step through the frames of an archive, the frame stays as it is past either end or if the next one cannot be read
+void step_frame(int step)
+{
+	int64_t frame_index = g_frame_index + step;
+	nframe f;
+
+	if (!g_is_archive || frame_index < 0 || frame_index >= g_archive.ar_frames || nframes_read(&g_archive, frame_index, &f))
+	{
+		return;
+	}
+
+	nframe_free(&g_nframe);
+
+	g_nframe = f;
+	g_frame_index = frame_index;
+}
+
 // render frame
 void render_frame()
 {
 	int c;
 	int r;
-	for (r = 0; r < g_nframe_row; r++)
+	for (r = 0; r < g_nframe.f_row; r++)
 	{
-		for (c = 0; c < g_nframe_col; c++)
+		if (g_backend == BACKEND_ANSI)
+		{
+			// each run of cells that share a color goes out as one piece
+			char run[NVIZ_MAX_COL];
+
+			for (c = 0; c < g_nframe.f_col; )
+			{
+				int start = c;
+				int len = 0;
+				char clr = g_nframe.f_cells[CH_BYTS * (g_nframe.f_col * r + c)];
+
+				while (c < g_nframe.f_col)
+				{
+					int index = CH_BYTS * (g_nframe.f_col * r + c);
+
+					if (g_color_mode && g_nframe.f_cells[index] != clr)
+					{
+						break;
+					}
+
+					run[len++] = PRINTABLE(g_nframe.f_cells[index + 1]) ? g_nframe.f_cells[index + 1] : ' ';
+					c++;
+				}
+
+				ansi_text(r, start, run, len, clr);
+			}
+
+			continue;
+		}
+
+		for (c = 0; c < g_nframe.f_col; c++)
 		{
 			char chr;
 			char clr;
 
-			int index = CH_BYTS * (g_nframe_col * r + c);
+			int index = CH_BYTS * (g_nframe.f_col * r + c);
 
-			clr = g_frame[index];
-			chr = g_frame[index + 1];
+			clr = g_nframe.f_cells[index];
+			chr = g_nframe.f_cells[index + 1];
 
 			if (g_color_mode)
 			{
@@ -121,86 +271,79 @@ void render_frame()
 
 	if (!g_hide_panel)
 	{
-		int i;
-		for (i = 0; i < g_col; i++)
-		{
-			mvaddch(g_row - 4, i, '-');
-		}
+		char line[g_col + 1];
+		memset(line, '-', g_col);
+		line[g_col] = 0;
 
-		// frame info
-		mvprintw(g_row - 3, 0, "col x row = %d x %d", g_nframe_col, g_nframe_row);
-		mvprintw(g_row - 1, 0, "file = %s", g_nframe_file_path);
-
-		// general controls
-		mvprintw(g_row - 3, g_col - 18, "q = quit nframe");
-		mvprintw(g_row - 2, g_col - 18, "p = toggle panel");
-	}
-}
-
-// initialize frame
-int init_frame()
-{
-	// declare and open the nframe file
-	FILE * nframe_file = fopen(g_nframe_file_path, "rb");
+		draw_text(g_row - 4, 0, "%s", line);
 
-	// check that the file could be opened
-	if (nframe_file == NULL)
-	{
-		return 1;
-	}
-
-	// calculate the file size
-	fseek(nframe_file, 0, SEEK_END);
-	int file_size = ftell(nframe_file);
-	fseek(nframe_file, 0, SEEK_SET);
+		// frame info
+		draw_text(g_row - 3, 0, "col x row = %d x %d", g_nframe.f_col, g_nframe.f_row);
+		draw_text(g_row - 1, 0, "file = %s", g_nframe_file_path);
 
-	// check that the file contains the nframe info
-	if (file_size < NFRM_HD)
-	{
-		fclose(nframe_file);
-		return 1;
-	}
+		if (g_is_archive)
+		{
+			draw_text(g_row - 2, 0, "frame = %lld / %lld", (long long) g_frame_index, (long long) g_archive.ar_frames - 1);
+		}
 
-	// input the nframe info
-	fread(&g_nframe_col, 1, 1, nframe_file);
-	fread(&g_nframe_row, 1, 1, nframe_file);
+		// general controls
+		draw_text(g_row - 3, g_col - 18, "q = quit nframe");
+		draw_text(g_row - 2, g_col - 18, "p = toggle panel");
 
-	// check that the file contains the nframe data
-	if (file_size < NFRM_HD + CH_BYTS * (g_nframe_col * g_nframe_row))
-	{
-		fclose(nframe_file);
-		return 1;
+		if (g_is_archive)
+		{
+			draw_text(g_row - 1, g_col - 18, "n/b = next/back");
+		}
 	}
-
-	// input the nframe data
-	fread(&g_frame, 1, CH_BYTS * (g_nframe_col * g_nframe_row), nframe_file);
-
-	// close the nframe file
-	fclose(nframe_file);
-
-	return 0;
 }
 
 // main
 int main (int argc, char * argv[])
 {
 	// command line input
-	if (argc < 2)
+	int opt;
+	while ((opt = getopt(argc, argv, "b:f:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'b':
+				if (strcmp(optarg, "ansi") == 0)
+				{
+					g_backend = BACKEND_ANSI;
+				}
+				else if (strcmp(optarg, "ncurses") != 0)
+				{
+					argc = 0;
+				}
+				break;
+			case 'f':
+				g_frame_index = strtoll(optarg, NULL, 10);
+				break;
+			default:
+				argc = 0;
+				break;
+		}
+	}
+
+	if (argc - optind < 1)
 	{
 		fprintf(stderr, "wrong number of arguments\n");
-		fprintf(stderr, "usage: %s filename\n", argv[0]);
+		fprintf(stderr, "usage: %s [-b ncurses|ansi] [-f frame] filename\n", argv[0]);
 		return 1;
 	}
 
-	sprintf(g_nframe_file_path, argv[1]);
+	sprintf(g_nframe_file_path, argv[optind]);
 
-	init_ncurses();
+	// an archive is read by frame number, anything else is a single .nframe file
+	g_is_archive = nframes_open(&g_archive, g_nframe_file_path) == 0;
 
-	if (init_frame())
+	init_screen();
+
+	if (g_is_archive ? nframes_read(&g_archive, g_frame_index, &g_nframe) : nframe_read(&g_nframe, g_nframe_file_path))
 	{
-		clear();
+		clear_screen();
 
-		deinit_ncurses();
+		deinit_screen();
 
 		fprintf(stderr, "could not open %s\n", g_nframe_file_path);
 
@@ -211,10 +354,10 @@ int main (int argc, char * argv[])
 	{
 		// render
 		render_frame();
-		refresh();
+		present_screen();
 
 		// input
-		g_ch = getch();
+		g_ch = read_key();
 
 		switch(g_ch)
 		{
@@ -224,12 +367,25 @@ int main (int argc, char * argv[])
 			case 'p':
 				toggle_panel();
 				break;
+			case 'n':
+				step_frame(1);
+				break;
+			case 'b':
+				step_frame(-1);
+				break;
 		}
 
-		clear();
+		clear_screen();
 	}
 
-	deinit_ncurses();
+	deinit_screen();
+
+	nframe_free(&g_nframe);
+
+	if (g_is_archive)
+	{
+		nframes_close(&g_archive);
+	}
 
 	return 0;
 }
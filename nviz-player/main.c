@@ -1,31 +1,57 @@
 // nviz-player - a simple ncurses program that plays .nviz video/visualization files
 // made by Nikola Whallon (https://github.com/nikolawhallon/nviz-project, nikola.whallon@gmail.com)
 
+#define _FILE_OFFSET_BITS 64
+
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
 #include <ncurses.h>
-#include <semaphore.h>
 #include <pthread.h>
 #include <signal.h>
 #include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+
+#include "nviz.h"
+#include "ansi.h"
+
+#define BACKEND_NCURSES 0
+#define BACKEND_ANSI 1
+
+#define PRINTABLE(chr) ((chr) >= 32 && (chr) <= 126)
 
-#define NVIZ_HD 5
-#define CH_BYTS	2
-#define MAX_COL 250
-#define MAX_ROW 75
-#define MAX_FPS 96
+typedef struct {
+	char * s_frame;
+	int64_t s_frame_index;
+	int s_seek_generation;				// which seek the frame was read for
+} frame_slot;
 
 typedef struct {
 	int t_running;
-	char * t_frame_pool;
-	char * t_nviz_file_path;
-	int t_nviz_col;
-	int t_nviz_row;
-	int t_nviz_fps;
-	int t_nviz_sec;
-	sem_t * t_switch_sem;
-	sem_t * t_read_sem;
-	int32_t t_read_frame_index;
+	frame_slot * t_frame_ring;
+	int t_frame_ring_size;
+	nviz_reader * t_nviz;
+	int64_t t_nviz_frames;				// 0 for a live stream, which is read until it ends
+	int64_t t_ring_head;				// frames published by the reader
+	int64_t t_ring_released;			// slots given back by the renderer
+	int64_t t_seek_frame_index;
+	int t_seek_generation;
+	int t_wakeup_fd;
+	int t_wake_renderer;				// set by the renderer while it waits on a frame
+	int t_reader_wakeup_fd;
+	int t_wake_reader;				// set by the reader while it waits on a free slot
+	int64_t t_read_nsec;				// time spent reading frames, for the perf stats
+	int64_t t_read_frames;
+	int t_ended;					// set by the reader when the file has no more frames
 } thread_info;
 
 //----------------------------------------------------				// GLOBAL VARIABLES
@@ -37,34 +63,77 @@ int g_running = 1;
 // nviz control
 int g_paused;
 int g_looping;
-int g_just_reset;
-int32_t g_render_frame_index;
-int32_t g_rewind_fast_forward_rate;
+int64_t g_render_frame_index;
+int64_t g_rewind_fast_forward_rate;
 
 // ncurses
 int g_col, g_row;
 int g_color_mode;
-
-// frame pool
-char g_frame_pool_0[CH_BYTS * (MAX_COL * MAX_ROW) * MAX_FPS];
-char g_frame_pool_1[CH_BYTS * (MAX_COL * MAX_ROW) * MAX_FPS];
-int g_frame_pool_rendering;
-int g_frame_pool_reading;
+int g_backend = BACKEND_NCURSES;
+
+// drawing
+char * g_drawn_frame;				// the frame as last drawn, cells that still match it are skipped
+int g_drawn_frame_valid;
+
+// events
+int g_timer_fd;					// fires when the next frame is due
+int g_wakeup_fd;				// written by the reader thread when a waited on frame is in
+int g_reader_wakeup_fd;				// written by the renderer when it gives back a slot the reader waits on
+int g_reader_quit_fd;				// written once on quit, it fails a read that waits on a quiet pipe
+
+// scheduler, frames are due at absolute times counted from the anchor
+int64_t g_play_anchor_nsec;
+int64_t g_play_frames;				// frames advanced since the anchor
+int64_t g_play_due_frames;			// frames that were due since the anchor, ahead of g_play_frames while the reader is behind
+int64_t g_presented_frames;
+int64_t g_dropped_frames;
+int64_t g_late_frames;
+
+// render stats, averaged over the last second of frames
+int g_proc_io_fd = -1;				// /proc/self/io, for the bytes ncurses writes to the terminal
+int64_t g_stats_start_terminal_bytes;
+int64_t g_stats_render_nsec;
+int g_stats_frames;
+int64_t g_render_usec_per_frame;
+int64_t g_render_bytes_per_frame;
+
+// perf stats, sampled once a second for the perf panel and the stats file
+FILE * g_stats_file;				// JSON lines, NULL when not requested
+int64_t g_stats_file_bytes;			// written to the stats file, they are not terminal output
+char g_stats_file_path[256];
+int g_proc_statm_fd = -1;			// /proc/self/statm, for the resident memory
+int64_t g_perf_start_nsec;
+int64_t g_perf_start_presented;
+int64_t g_perf_start_read_nsec;
+int64_t g_perf_start_read_frames;
+double g_presented_fps;
+int64_t g_read_usec_per_frame;			// -1 when frames come straight from the mapping
+int g_read_ahead_frames;			// frames read but not yet taken, -1 when mapped
+int64_t g_resident_kb;
+
+// frame ring
+frame_slot * g_frame_ring;
+int g_frame_ring_size;				// read ahead frames, plus the slot being rendered
+int g_frame_ring_rendering;			// slot being rendered, -1 when none is held
+int64_t g_frame_ring_taken;			// frames taken out of the ring by the renderer
+int g_read_ahead;				// 0 means one second of frames
+int g_seek_generation;
+int g_seek_pending;				// a seek target has not been read yet
+char * g_seek_hold_frame;			// the frame on screen while a seek is pending
+char * g_render_frame;				// points into the mapping, at a ring slot, or at the seek hold frame
 
 // nviz
 char g_nviz_file_path[256];
+nviz_reader g_nviz;				// r_in_place when raw frames are served out of the mapping, otherwise they go through the reader thread
 int g_nviz_col;
 int g_nviz_row;
 int g_nviz_fps;
-int g_nviz_sec;
+int64_t g_nviz_frames;				// 0 for a live stream
+int g_live;					// a stream of unknown length, played as it comes in
 
 // panels
 int g_hide_panel = 0;
-int g_info_control_panel = 0;
-
-// semaphore
-sem_t * g_switch_sem;
-sem_t * g_read_sem;
+int g_info_control_panel = 0;			// 0 info, 1 controls, 2 performance
 
 // thread
 pthread_attr_t g_read_thread_attr;
@@ -130,444 +199,1396 @@ void deinit_ncurses()
 	endwin();
 }
 
-// toggle_panel
-void toggle_panel()
+// initialize the screen with the chosen backend
+void init_screen()
 {
-	g_hide_panel ^= 1;
+	if (g_backend == BACKEND_ANSI)
+	{
+		// keys come in without waiting, the player polls for them
+		ansi_init(0);
 
-	clear();
+		g_col = g_ansi_col;
+		g_row = g_ansi_row;
+		g_color_mode = 1;
+	}
+	else
+	{
+		init_ncurses();
+	}
 }
 
-// set_info_control_panel
-void set_info_control_panel(int info_or_control)
+// deinitialize the screen
+void deinit_screen()
 {
-	g_info_control_panel = info_or_control;
-
-	clear();
+	if (g_backend == BACKEND_ANSI)
+	{
+		ansi_deinit();
+	}
+	else
+	{
+		deinit_ncurses();
+	}
 }
 
-// switch frame pools
-void switch_frame_pools(int32_t _read_frame_index)
+// clear the screen, the next frame is drawn in full
+void clear_screen()
 {
-	sem_wait(g_switch_sem);
-
-	g_frame_pool_rendering ^= 1;
-	g_frame_pool_reading ^= 1;
-
-	if (g_frame_pool_reading == 0)
+	if (g_backend == BACKEND_ANSI)
 	{
-		g_thread_info.t_frame_pool = g_frame_pool_0;
+		ansi_clear();
 	}
 	else
 	{
-		g_thread_info.t_frame_pool = g_frame_pool_1;
+		clear();
 	}
 
-	g_thread_info.t_read_frame_index = _read_frame_index;
-
-	sem_post(g_read_sem);
+	g_drawn_frame_valid = 0;
 }
 
-// read frames thread
-static void * read_frames(void * param)
+// put the drawn frame on the terminal
+void present_screen()
 {
-	thread_info * ti = (thread_info *) param;
-
-	while (ti->t_running)
+	if (g_backend == BACKEND_ANSI)
 	{
-		sem_wait(ti->t_read_sem);
-
-		FILE * nviz_file = fopen(ti->t_nviz_file_path, "rb");
-
-		fseek(nviz_file, NVIZ_HD + CH_BYTS * (ti->t_nviz_col * ti->t_nviz_row) * ti->t_read_frame_index, SEEK_SET);
-		fread(ti->t_frame_pool, 1, CH_BYTS * (ti->t_nviz_col * ti->t_nviz_row) * ti->t_nviz_fps, nviz_file);
+		ansi_flush();
+	}
+	else
+	{
+		refresh();
+	}
+}
 
-		fclose(nviz_file);
+// the next key that was pressed, ERR if there is none
+int read_key()
+{
+	if (g_backend == BACKEND_ANSI)
+	{
+		unsigned char key;
 
-		sem_post(ti->t_switch_sem);
+		return read(STDIN_FILENO, &key, 1) == 1 ? key : ERR;
 	}
+
+	return getch();
 }
 
-// reset to render frame index
-void reset_to_render_frame_index()
+// draw formatted text at r, c in the default color
+void draw_text(int r, int c, const char * format, ...)
 {
-	switch_frame_pools(g_nviz_fps * (g_render_frame_index / g_nviz_fps));
+	char text[1024];
+	va_list args;
 
-	if (g_nviz_fps * (g_render_frame_index / g_nviz_fps) + g_nviz_fps < g_nviz_fps * g_nviz_sec)
+	va_start(args, format);
+	vsnprintf(text, sizeof(text), format, args);
+	va_end(args);
+
+	if (g_backend == BACKEND_NCURSES)
 	{
-		switch_frame_pools(g_nviz_fps * (g_render_frame_index / g_nviz_fps) + g_nviz_fps);
+		mvaddstr(r, c, text);
+
+		return;
 	}
-	else
+
+	// expand tabs the way ncurses does
+	char expanded[2048];
+	int len = 0;
+	int i;
+
+	for (i = 0; text[i] != 0 && len < (int) sizeof(expanded) - 8; i++)
 	{
-		switch_frame_pools(0);
+		if (text[i] == '\t')
+		{
+			do
+			{
+				expanded[len++] = ' ';
+			}
+			while ((c + len) % 8 != 0);
+		}
+		else
+		{
+			expanded[len++] = text[i];
+		}
 	}
 
-	g_just_reset = 1;
+	ansi_text(r, c, expanded, len, 0);
 }
 
-// initialize nviz
-int init_nviz()
+// toggle_panel
+void toggle_panel()
 {
-	// frame pool
-	g_frame_pool_rendering = 0;
-	g_frame_pool_reading = 1;
+	g_hide_panel ^= 1;
 
-	// nviz control
-	g_paused = 1;
-	g_looping = 1;
-	g_render_frame_index = 0;
-	g_rewind_fast_forward_rate = 1;
+	clear_screen();
+}
 
-	// declare and open the nviz file
-	FILE * nviz_file = fopen(g_nviz_file_path, "rb");
+// set_info_control_panel
+void set_info_control_panel(int panel)
+{
+	g_info_control_panel = panel;
 
-	// check that the file could be opened
-	if (nviz_file == NULL)
-	{
-		return 1;
-	}
+	clear_screen();
+}
 
-	// calculate the file size
-	fseek(nviz_file, 0, SEEK_END);
-	int32_t file_size = ftell(nviz_file);
-	fseek(nviz_file, 0, SEEK_SET);
+// bytes written by this process so far, -1 if unknown
+int64_t read_wchar()
+{
+	char buf[256];
 
-	// check that the file contains the nviz info
-	if (file_size < NVIZ_HD)
+	if (g_proc_io_fd < 0)
 	{
-		fclose(nviz_file);
-		return 1;
+		return -1;
 	}
 
-	// input the nviz info
-	fread(&g_nviz_col, 1, 1, nviz_file);
-	fread(&g_nviz_row, 1, 1, nviz_file);
-	fread(&g_nviz_fps, 1, 1, nviz_file);
-	fread(&g_nviz_sec, 2, 1, nviz_file);
+	ssize_t n = pread(g_proc_io_fd, buf, sizeof(buf) - 1, 0);
 
-	// check that the file contains the nviz data
-	if (file_size < NVIZ_HD + CH_BYTS * (g_nviz_col * g_nviz_row) * g_nviz_fps * g_nviz_sec)
+	if (n <= 0)
 	{
-		fclose(nviz_file);
-		return 1;
+		return -1;
 	}
 
-	// close the nviz file
-	fclose(nviz_file);
-
-	// semaphore
-	g_switch_sem = sem_open("/switchsem", O_CREAT, S_IRUSR | S_IWUSR, 1);
-	g_read_sem = sem_open("/readsem", O_CREAT, S_IRUSR | S_IWUSR, 0);
-
-	// thread
-	g_thread_info.t_running = 1;
-	g_thread_info.t_frame_pool = g_frame_pool_1;
-	g_thread_info.t_nviz_file_path = g_nviz_file_path;
-	g_thread_info.t_nviz_col = g_nviz_col;
-	g_thread_info.t_nviz_row = g_nviz_row;
-	g_thread_info.t_nviz_fps = g_nviz_fps;
-	g_thread_info.t_nviz_sec = g_nviz_sec;
-	g_thread_info.t_switch_sem = g_switch_sem;
-	g_thread_info.t_read_sem = g_read_sem;
-	g_thread_info.t_read_frame_index = 0;
+	buf[n] = 0;
 
-	pthread_attr_init(&g_read_thread_attr);
-	pthread_attr_setstacksize(&g_read_thread_attr, 0x10000000);
-	pthread_create(&g_read_thread_id, &g_read_thread_attr, &read_frames, &g_thread_info);
+	char * wchar = strstr(buf, "wchar: ");
 
-	// read in the first frame pool
-	reset_to_render_frame_index();
+	if (wchar == NULL)
+	{
+		return -1;
+	}
 
-	return 0;
+	return strtoll(wchar + 7, NULL, 10);
 }
 
-// deinitialize
-void deinit_nviz()
+// bytes written to the terminal so far, -1 if unknown
+// the ansi backend counts what it flushes, exactly, ncurses writes on its own, so for it this is only an approximation,
+// every byte the process wrote less the stats file, which includes anything else it writes, like stderr
+int64_t read_terminal_bytes()
 {
-	g_thread_info.t_running = 0;
-	sem_post(g_read_sem);
-	pthread_join(g_read_thread_id, NULL);
+	if (g_backend == BACKEND_ANSI)
+	{
+		return g_ansi_bytes;
+	}
 
-	sem_close(g_switch_sem);
-	sem_unlink("/switchsem");
+	int64_t wchar = read_wchar();
 
-	sem_close(g_read_sem);
-	sem_unlink("/readsem");
+	return wchar < 0 ? -1 : wchar - g_stats_file_bytes;
 }
 
-// start/stop
-void start_stop()
+// nanoseconds on the monotonic clock
+int64_t now_nsec()
 {
-	g_paused ^= 1;
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
 
-	reset_to_render_frame_index();
+	return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
 }
 
-// toggle looping
-void toggle_looping()
+// initialize render stats
+void init_render_stats()
 {
-	g_looping ^= 1;
+	g_proc_io_fd = open("/proc/self/io", O_RDONLY);
+	g_stats_start_terminal_bytes = read_terminal_bytes();
+	g_stats_render_nsec = 0;
+	g_stats_frames = 0;
+	g_render_usec_per_frame = 0;
+	g_render_bytes_per_frame = -1;
 }
 
-// increase the rewind/fast forward rate
-void up_rewind_fast_forward_rate()
+// deinitialize render stats
+void deinit_render_stats()
 {
-	if (g_rewind_fast_forward_rate == 1)
+	if (g_proc_io_fd >= 0)
 	{
-		g_rewind_fast_forward_rate = g_nviz_fps;
+		close(g_proc_io_fd);
 	}
-	else if (g_rewind_fast_forward_rate != g_nviz_fps * g_nviz_sec - g_nviz_fps)
+}
+
+// add a rendered frame to the stats, once a second of frames has been rendered the averages are updated
+void update_render_stats(int64_t render_nsec)
+{
+	g_stats_render_nsec += render_nsec;
+	g_stats_frames++;
+
+	if (g_stats_frames < g_nviz_fps)
 	{
-		g_rewind_fast_forward_rate += g_nviz_fps;
+		return;
 	}
+
+	int64_t terminal_bytes = read_terminal_bytes();
+
+	g_render_usec_per_frame = g_stats_render_nsec / 1000 / g_stats_frames;
+	g_render_bytes_per_frame = (terminal_bytes < 0 || g_stats_start_terminal_bytes < 0) ? -1 : (terminal_bytes - g_stats_start_terminal_bytes) / g_stats_frames;
+
+	g_stats_start_terminal_bytes = terminal_bytes;
+	g_stats_render_nsec = 0;
+	g_stats_frames = 0;
 }
 
-// decrease the rewind/fast forward rate
-void down_rewind_fast_forward_rate()
+// resident memory of this process in KB, -1 if unknown
+int64_t read_resident_kb()
 {
-	if (g_rewind_fast_forward_rate == g_nviz_fps)
+	char buf[128];
+	long size;
+	long resident;
+
+	if (g_proc_statm_fd < 0)
 	{
-		g_rewind_fast_forward_rate = 1;
+		return -1;
 	}
-	else if (g_rewind_fast_forward_rate != 1)
+
+	ssize_t n = pread(g_proc_statm_fd, buf, sizeof(buf) - 1, 0);
+
+	if (n <= 0)
 	{
-		g_rewind_fast_forward_rate -= g_nviz_fps;
+		return -1;
+	}
+
+	buf[n] = 0;
+
+	if (sscanf(buf, "%ld %ld", &size, &resident) != 2)
+	{
+		return -1;
 	}
+
+	return (int64_t) resident * (sysconf(_SC_PAGESIZE) / 1024);
 }
 
-// rewind
-void rewind_nviz()
+// initialize perf stats, opening the stats file if one was asked for
+int init_perf_stats()
 {
-	int32_t previous_frame_index = g_render_frame_index;
-
-	if (g_render_frame_index - g_rewind_fast_forward_rate >= 0)
+	if (g_stats_file_path[0] != 0)
 	{
-		g_render_frame_index -= g_rewind_fast_forward_rate;
+		g_stats_file = fopen(g_stats_file_path, "w");
+
+		if (g_stats_file == NULL)
+		{
+			return 1;
+		}
 	}
-	else
+
+	g_proc_statm_fd = open("/proc/self/statm", O_RDONLY);
+	g_perf_start_nsec = now_nsec();
+	g_perf_start_presented = 0;
+	g_perf_start_read_nsec = 0;
+	g_perf_start_read_frames = 0;
+	g_presented_fps = 0;
+	g_read_usec_per_frame = -1;
+	g_read_ahead_frames = -1;
+	g_resident_kb = read_resident_kb();
+
+	return 0;
+}
+
+// deinitialize perf stats
+void deinit_perf_stats()
+{
+	if (g_stats_file != NULL)
 	{
-		g_render_frame_index = 0;
+		fclose(g_stats_file);
 	}
 
-	if (g_nviz_fps * (g_render_frame_index / g_nviz_fps) != g_nviz_fps * (previous_frame_index / g_nviz_fps))
+	if (g_proc_statm_fd >= 0)
 	{
-		reset_to_render_frame_index();
+		close(g_proc_statm_fd);
 	}
 }
 
-// fast forward
-void fast_forward_nviz()
+// take a perf sample once a second has passed, returns 1 if one was taken
+int update_perf_stats()
 {
-	int32_t previous_frame_index = g_render_frame_index;
+	int64_t now = now_nsec();
 
-	if (g_render_frame_index + g_rewind_fast_forward_rate < g_nviz_fps * g_nviz_sec)
+	if (now - g_perf_start_nsec < 1000000000)
 	{
-		g_render_frame_index += g_rewind_fast_forward_rate;
+		return 0;
 	}
-	else
+
+	g_presented_fps = (g_presented_frames - g_perf_start_presented) * 1e9 / (now - g_perf_start_nsec);
+	g_resident_kb = read_resident_kb();
+
+	if (!g_nviz.r_in_place)
 	{
-		g_render_frame_index = g_nviz_fps * g_nviz_sec - 1;
+		int64_t read_nsec = __atomic_load_n(&g_thread_info.t_read_nsec, __ATOMIC_RELAXED);
+		int64_t read_frames = __atomic_load_n(&g_thread_info.t_read_frames, __ATOMIC_RELAXED);
+
+		if (read_frames > g_perf_start_read_frames)
+		{
+			g_read_usec_per_frame = (read_nsec - g_perf_start_read_nsec) / 1000 / (read_frames - g_perf_start_read_frames);
+		}
+
+		g_read_ahead_frames = __atomic_load_n(&g_thread_info.t_ring_head, __ATOMIC_RELAXED) - g_frame_ring_taken;
+
+		g_perf_start_read_nsec = read_nsec;
+		g_perf_start_read_frames = read_frames;
 	}
 
-	if (g_nviz_fps * (g_render_frame_index / g_nviz_fps) != g_nviz_fps * (previous_frame_index / g_nviz_fps))
+	if (g_stats_file != NULL)
 	{
-		reset_to_render_frame_index();
+		// wall clock time, to line up with other logs
+		struct timespec wall;
+		clock_gettime(CLOCK_REALTIME, &wall);
+
+		int len = fprintf(g_stats_file,
+			"{\"time_ms\": %ld, \"frame\": %lld, \"started\": %d, \"fps\": %.1f, \"presented\": %ld, \"dropped\": %ld, \"late\": %ld, "
+			"\"render_us\": %ld, \"%s\": %ld, \"read_us\": %ld, \"read_ahead\": %d, \"resident_kb\": %ld}\n",
+			(long) wall.tv_sec * 1000 + wall.tv_nsec / 1000000, (long long) g_render_frame_index, !g_paused, g_presented_fps, (long) g_presented_frames, (long) g_dropped_frames, (long) g_late_frames,
+			(long) g_render_usec_per_frame, g_backend == BACKEND_ANSI ? "render_bytes" : "render_bytes_approx", (long) g_render_bytes_per_frame, (long) g_read_usec_per_frame, g_read_ahead_frames, (long) g_resident_kb);
+		fflush(g_stats_file);
+
+		if (len > 0)
+		{
+			g_stats_file_bytes += len;
+		}
 	}
+
+	g_perf_start_nsec = now;
+	g_perf_start_presented = g_presented_frames;
+
+	return 1;
 }
 
-// render
-void render()
+// offset of a frame in the nviz file
+off_t frame_offset(int64_t frame_index)
 {
-	int c;
-	int r;
-	for (r = 0; r < g_nviz_row; r++)
+	return nviz_frame_offset(&g_nviz.r_header, frame_index);
+}
+
+// read frames thread
+static void * read_frames(void * param)
+{
+	thread_info * ti = (thread_info *) param;
+
+	int64_t head = 0;
+	int generation = -1;
+	int64_t frame_index = 0;
+
+	while (__atomic_load_n(&ti->t_running, __ATOMIC_ACQUIRE))
 	{
-		for (c = 0; c < g_nviz_col; c++)
+		// one slot is always held by the renderer, the rest can be read ahead
+		if (head - __atomic_load_n(&ti->t_ring_released, __ATOMIC_SEQ_CST) >= ti->t_frame_ring_size - 1)
 		{
-			char chr;
-			char clr;
+			// ask the renderer for a wakeup, then check again in case a slot was given back meanwhile
+			__atomic_store_n(&ti->t_wake_reader, 1, __ATOMIC_SEQ_CST);
 
-			int32_t index = CH_BYTS * ((g_nviz_col * g_nviz_row) * (g_render_frame_index % g_nviz_fps) + g_nviz_col * r + c);
-
-			if (g_frame_pool_rendering == 1)
-			{
-				clr = g_frame_pool_1[index];
-				chr = g_frame_pool_1[index + 1];
-			}
-			else
+			if (head - __atomic_load_n(&ti->t_ring_released, __ATOMIC_SEQ_CST) >= ti->t_frame_ring_size - 1)
 			{
-				clr = g_frame_pool_0[index];
-				chr = g_frame_pool_0[index + 1];
+				uint64_t wakeups;
+				read(ti->t_reader_wakeup_fd, &wakeups, sizeof(wakeups));
 			}
 
-			if (g_color_mode)
+			continue;
+		}
+
+		int slot = head % ti->t_frame_ring_size;
+
+		// restart from the seek target whenever the renderer has seeked
+		if (__atomic_load_n(&ti->t_seek_generation, __ATOMIC_ACQUIRE) != generation)
+		{
+			generation = __atomic_load_n(&ti->t_seek_generation, __ATOMIC_ACQUIRE);
+			frame_index = __atomic_load_n(&ti->t_seek_frame_index, __ATOMIC_ACQUIRE);
+		}
+
+		frame_slot * fs = &ti->t_frame_ring[slot];
+
+		while (1)
+		{
+			int64_t read_start = now_nsec();
+
+			if (nviz_read_frame(ti->t_nviz, frame_index, fs->s_frame))
 			{
-				attron(COLOR_PAIR(clr));
+				__atomic_store_n(&ti->t_ended, 1, __ATOMIC_RELEASE);
+				break;
 			}
 
-			mvaddch(r, c, chr);
+			__atomic_add_fetch(&ti->t_read_nsec, now_nsec() - read_start, __ATOMIC_RELAXED);
+			__atomic_add_fetch(&ti->t_read_frames, 1, __ATOMIC_RELAXED);
 
-			if (g_color_mode)
+			// a seek that came in during the read is served first, into the same slot
+			if (__atomic_load_n(&ti->t_seek_generation, __ATOMIC_ACQUIRE) == generation)
 			{
-				attroff(COLOR_PAIR(clr));
+				break;
 			}
-		}
-	}
 
-	if (!g_hide_panel)
-	{
-		int i;
-		for (i = 0; i < g_col; i++)
-		{
-			mvaddch(g_row - 7, i, '-');
+			generation = __atomic_load_n(&ti->t_seek_generation, __ATOMIC_ACQUIRE);
+			frame_index = __atomic_load_n(&ti->t_seek_frame_index, __ATOMIC_ACQUIRE);
 		}
 
-		// video info
-		if (g_info_control_panel == 0)
+		// the end of a live stream, or a file that could not be read, wakes the renderer for good
+		if (__atomic_load_n(&ti->t_ended, __ATOMIC_ACQUIRE))
 		{
-			mvprintw(g_row - 6, 0, "col x row = %d x %d", g_nviz_col, g_nviz_row);
-			mvprintw(g_row - 5, 0, "fps = %d", g_nviz_fps);
-			mvprintw(g_row - 4, 0, "seconds = %d / %d\t", g_render_frame_index / g_nviz_fps, g_nviz_sec);
-			mvprintw(g_row - 3, 0, "frames = %d / %d\t", g_render_frame_index, g_nviz_fps * g_nviz_sec - 1);
-			mvprintw(g_row - 1, 0, "file = %s", g_nviz_file_path);
+			break;
 		}
 
-		// video controls
-		if (g_info_control_panel == 1)
+		fs->s_frame_index = frame_index;
+		fs->s_seek_generation = generation;
+
+		frame_index = ti->t_nviz_frames > 0 ? (frame_index + 1) % ti->t_nviz_frames : frame_index + 1;
+
+		// publish the frame, the renderer picks it up without a syscall
+		head++;
+		__atomic_store_n(&ti->t_ring_head, head, __ATOMIC_SEQ_CST);
+
+		// only wake the renderer when it is waiting, so the common case costs no syscall
+		if (__atomic_exchange_n(&ti->t_wake_renderer, 0, __ATOMIC_SEQ_CST))
 		{
-			mvprintw(g_row - 6, 0, "s = start/stop");
-			mvprintw(g_row - 5, 0, "l = toggle looping");
-			mvprintw(g_row - 4, 0, "r = rewind");
-			mvprintw(g_row - 3, 0, "f = fast forward");
-			mvprintw(g_row - 2, 0, "u = increase rewind/fast forward rate");
-			mvprintw(g_row - 1, 0, "d = decrease rewind/fast forward rate");
+			uint64_t one = 1;
+			write(ti->t_wakeup_fd, &one, sizeof(one));
 		}
+	}
 
-		mvprintw(g_row - 6, g_col / 2 - 12, "started = %d", !g_paused);
-		mvprintw(g_row - 5, g_col / 2 - 12, "looping = %d", g_looping);
-		mvprintw(g_row - 4, g_col / 2 - 12, "rewind/fast forward rate = %d", g_rewind_fast_forward_rate);
+	// a renderer waiting on a frame that will never come is let go
+	uint64_t one = 1;
+	write(ti->t_wakeup_fd, &one, sizeof(one));
 
-		// general controls
-		mvprintw(g_row - 6, g_col - 18, "q = quit nviz");
-		mvprintw(g_row - 5, g_col - 18, "i = info panel");
-		mvprintw(g_row - 4, g_col - 18, "c = control panel");
-		mvprintw(g_row - 3, g_col - 18, "p = toggle panel");
-	}
+	return NULL;
 }
 
-// main
-int main (int argc, char * argv[])
+// take the next frame out of the ring, returns 1 if block is 0 and it has not been read yet, or if the file has no more frames
+int acquire_frame(int64_t frame_index, int block)
 {
-	// command line input
-	if (argc != 2)
+	// mapped files are served in place, there is nothing to wait for
+	if (g_nviz.r_in_place)
 	{
-		fprintf(stderr, "ERROR - wrong number of arguments\n");
-		fprintf(stderr, "usage: %s filename\n", argv[0]);
-		return 1;
-	}
-
-	sprintf(g_nviz_file_path, argv[1]);
+		g_render_frame = g_nviz.r_map + frame_offset(frame_index);
 
-	// initialize ncurses
-	init_ncurses();
-
-	// initialize nviz
-	if (init_nviz())
-	{
-		deinit_ncurses();
-		fprintf(stderr, "ERROR - could not open %s\n", g_nviz_file_path);
-		return 1;
+		return 0;
 	}
 
-	while (g_running)
+	while (1)
 	{
-		// input
-		g_ch = getch();
-
-		switch (g_ch)
+		if (g_frame_ring_taken == __atomic_load_n(&g_thread_info.t_ring_head, __ATOMIC_SEQ_CST))
 		{
-			case 'q':
-				g_running = 0;
-				break;
-			case 'p':
-				toggle_panel();
-				break;
-			case 'i':
-				set_info_control_panel(0);
-				break;
-			case 'c':
-				set_info_control_panel(1);
-				break;
-			case 's':
-				start_stop();
-				break;
-			case 'l':
-				toggle_looping();
-				break;
-			case 'u':
-				up_rewind_fast_forward_rate();
-				break;
-			case 'd':
-				down_rewind_fast_forward_rate();
-				break;
-			case 'r':
-				rewind_nviz();
-				break;
-			case 'f':
-				fast_forward_nviz();
-				break;
-		}
+			// ask the reader thread for a wakeup, then check again in case the frame came in meanwhile
+			__atomic_store_n(&g_thread_info.t_wake_renderer, 1, __ATOMIC_SEQ_CST);
 
-		// update
-		if (!g_paused)
-		{
-			if (!g_just_reset)
+			if (g_frame_ring_taken == __atomic_load_n(&g_thread_info.t_ring_head, __ATOMIC_SEQ_CST))
 			{
-				if (g_render_frame_index + 1 > g_nviz_fps * g_nviz_sec)
+				if (!block || __atomic_load_n(&g_thread_info.t_ended, __ATOMIC_ACQUIRE))
 				{
-					g_render_frame_index = 0;
+					return 1;
 				}
 
-				if (g_render_frame_index % g_nviz_fps == 0)
-				{
-					if (g_render_frame_index + g_nviz_fps == g_nviz_fps * g_nviz_sec)
-					{
-						switch_frame_pools(0);
-					}
-					else
-					{
-						switch_frame_pools(g_render_frame_index + g_nviz_fps);
-					}
-				}
-			}
-			else
-			{
-				g_just_reset = 0;
+				struct pollfd pfd = { g_wakeup_fd, POLLIN, 0 };
+				uint64_t wakeups;
+
+				poll(&pfd, 1, -1);
+				read(g_wakeup_fd, &wakeups, sizeof(wakeups));
 			}
 
-			if (!g_looping && g_render_frame_index == g_nviz_fps * g_nviz_sec - 1)
+			continue;
+		}
+
+		int slot = g_frame_ring_taken % g_frame_ring_size;
+
+		g_frame_ring_taken++;
+
+		// give back the slot that was being rendered, the reader is only woken if it is waiting on it
+		if (g_frame_ring_rendering >= 0)
+		{
+			__atomic_store_n(&g_thread_info.t_ring_released, g_thread_info.t_ring_released + 1, __ATOMIC_SEQ_CST);
+
+			if (__atomic_exchange_n(&g_thread_info.t_wake_reader, 0, __ATOMIC_SEQ_CST))
 			{
-				g_paused = 1;
+				uint64_t one = 1;
+				write(g_reader_wakeup_fd, &one, sizeof(one));
 			}
 		}
 
-		// render
-		render();
-		refresh();
-		napms(1000 / g_nviz_fps);
+		g_frame_ring_rendering = slot;
 
-		// next frame
-		if (!g_paused)
+		// frames read ahead of a seek are thrown away
+		if (g_frame_ring[slot].s_seek_generation == g_seek_generation)
 		{
-			g_render_frame_index++;
+			break;
 		}
 	}
 
+	g_render_frame = g_frame_ring[g_frame_ring_rendering].s_frame;
+
+	return 0;
+}
+
+// the time the nth frame since the anchor is due
+int64_t frame_deadline(int64_t n)
+{
+	return g_play_anchor_nsec + n * 1000000000 / g_nviz_fps;
+}
+
+// arm the frame timer for the next frame that is due, or disarm it while paused
+void arm_frame_timer()
+{
+	struct itimerspec its = { 0 };
+
+	// a live stream is not paced, frames are shown as they come in
+	if (!g_paused && !g_live)
+	{
+		int64_t deadline = frame_deadline(g_play_due_frames + 1);
+
+		its.it_value.tv_sec = deadline / 1000000000;
+		its.it_value.tv_nsec = deadline % 1000000000;
+	}
+
+	timerfd_settime(g_timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+// restart the schedule with the render frame due now
+void reset_schedule()
+{
+	g_play_anchor_nsec = now_nsec();
+	g_play_frames = 0;
+	g_play_due_frames = 0;
+}
+
+// advance to the frame that is due now, frames already past their deadline are dropped without being rendered
+// returns 1 if the render frame changed
+int schedule_frames()
+{
+	int64_t due = (now_nsec() - g_play_anchor_nsec) * g_nviz_fps / 1000000000;
+	int advanced = 0;
+
+	// a live stream skips to the newest frame that has come in, so it never falls behind the writer
+	if (g_live)
+	{
+		while (!acquire_frame(g_render_frame_index + 1, 0))
+		{
+			if (advanced)
+			{
+				g_dropped_frames++;
+			}
+
+			g_render_frame_index++;
+			g_play_frames++;
+			advanced = 1;
+		}
+
+		return advanced;
+	}
+
+	g_play_due_frames = due;
+
+	while (g_play_frames < due)
+	{
+		if (!g_looping && g_render_frame_index == g_nviz_frames - 1)
+		{
+			break;
+		}
+
+		// a frame that has not been read yet is shown late rather than waited for
+		int64_t next_frame_index = (g_render_frame_index + 1) % g_nviz_frames;
+
+		if (acquire_frame(next_frame_index, 0))
+		{
+			break;
+		}
+
+		if (advanced)
+		{
+			g_dropped_frames++;
+		}
+
+		g_render_frame_index = next_frame_index;
+		g_play_frames++;
+		advanced = 1;
+	}
+
+	return advanced;
+}
+
+// ask the kernel to start reading a second of mapped frames from frame_index
+void prefetch_frames(int64_t frame_index)
+{
+	long page = sysconf(_SC_PAGESIZE);
+	off_t start = frame_offset(frame_index) & ~((off_t) page - 1);
+	off_t end = frame_offset(frame_index + g_nviz_fps);
+
+	if (end > (off_t) g_nviz.r_map_size)
+	{
+		end = g_nviz.r_map_size;
+	}
+
+	madvise(g_nviz.r_map + start, end - start, MADV_WILLNEED);
+}
+
+// fault in every page of a mapped frame, so a benchmark counts the faults as io wait and not as render time
+void touch_frame(int64_t frame_index)
+{
+	long page = sysconf(_SC_PAGESIZE);
+	off_t start = frame_offset(frame_index) & ~((off_t) page - 1);
+	off_t end = frame_offset(frame_index) + g_nviz.r_header.h_frame_bytes;
+	volatile char touched;
+
+	madvise(g_nviz.r_map + start, end - start, MADV_WILLNEED);
+
+	off_t offset;
+	for (offset = start; offset < end; offset += page)
+	{
+		touched = g_nviz.r_map[offset];
+	}
+
+	(void) touched;
+}
+
+// seek to the render frame index, the current frame stays on screen until the target has been read
+void seek_to_render_frame_index()
+{
+	if (g_nviz.r_in_place)
+	{
+		prefetch_frames(g_render_frame_index);
+		acquire_frame(g_render_frame_index, 0);
+		reset_schedule();
+
+		return;
+	}
+
+	// the slot on screen is given back while stale frames are skipped, so hold a copy of it
+	if (!g_seek_pending)
+	{
+		memcpy(g_seek_hold_frame, g_render_frame, CH_BYTS * (g_nviz_col * g_nviz_row));
+		g_render_frame = g_seek_hold_frame;
+	}
+
+	g_seek_generation++;
+
+	__atomic_store_n(&g_thread_info.t_seek_frame_index, g_render_frame_index, __ATOMIC_RELEASE);
+	__atomic_store_n(&g_thread_info.t_seek_generation, g_seek_generation, __ATOMIC_RELEASE);
+
+	// stale read ahead is drained now, which frees the reader for the target
+	g_seek_pending = acquire_frame(g_render_frame_index, 0);
+
+	reset_schedule();
+}
+
+// check whether a pending seek target has come in, returns 1 if it just did
+int finish_seek()
+{
+	if (!g_seek_pending || acquire_frame(g_render_frame_index, 0))
+	{
+		return 0;
+	}
+
+	g_seek_pending = 0;
+
+	// playback carries on from when the target was shown
+	reset_schedule();
+
+	return 1;
+}
+
+// deinitialize
+void deinit_nviz()
+{
+	// frames served in place need no reader thread, the mapping is undone by nviz_close
+	if (!g_nviz.r_in_place)
+	{
+		uint64_t one = 1;
+
+		__atomic_store_n(&g_thread_info.t_running, 0, __ATOMIC_RELEASE);
+		write(g_reader_wakeup_fd, &one, sizeof(one));
+		write(g_reader_quit_fd, &one, sizeof(one));
+		pthread_join(g_read_thread_id, NULL);
+
+		close(g_reader_wakeup_fd);
+		close(g_reader_quit_fd);
+
+		int i;
+		for (i = 0; i < g_frame_ring_size; i++)
+		{
+			free(g_frame_ring[i].s_frame);
+		}
+
+		free(g_frame_ring);
+		free(g_seek_hold_frame);
+	}
+
+	free(g_drawn_frame);
+
+	nviz_close(&g_nviz);
+
+	close(g_timer_fd);
+	close(g_wakeup_fd);
+}
+
+// initialize nviz
+int init_nviz()
+{
+	// nviz control
+	g_paused = 1;
+	g_looping = 1;
+	g_render_frame_index = 0;
+	g_rewind_fast_forward_rate = 1;
+
+	// events
+	g_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	g_wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+	// open the nviz file once, it stays open until deinit_nviz
+	// the header is validated and a regular file is mapped whole, frames are then rendered straight out of the page cache
+	// a file bigger than the address space, on a 32 bit build, or a pipe is read through the ring instead
+	if (nviz_open(&g_nviz, g_nviz_file_path))
+	{
+		return 1;
+	}
+
+	g_nviz_col = g_nviz.r_header.h_col;
+	g_nviz_row = g_nviz.r_header.h_row;
+	g_nviz_fps = g_nviz.r_header.h_fps;
+	g_nviz_frames = g_nviz.r_frames;
+
+	// a file written without knowing its length and read from a pipe is a live stream, played until the writer closes it
+	g_live = g_nviz.r_live;
+
+	if (g_live)
+	{
+		g_paused = 0;
+	}
+
+	// the last drawn frame
+	g_drawn_frame = malloc(CH_BYTS * (g_nviz_col * g_nviz_row));
+	g_drawn_frame_valid = 0;
+
+	// raw frames served out of the mapping need no reader thread, compressed ones are decoded on it
+	if (g_nviz.r_in_place)
+	{
+		seek_to_render_frame_index();
+
+		return 0;
+	}
+
+	// frame ring, sized from the nviz info
+	if (g_read_ahead <= 0)
+	{
+		g_read_ahead = g_nviz_fps;
+	}
+
+	g_frame_ring_size = g_read_ahead + 1;
+	g_frame_ring_rendering = -1;
+	g_frame_ring_taken = 0;
+	g_frame_ring = malloc(g_frame_ring_size * sizeof(frame_slot));
+
+	int i;
+	for (i = 0; i < g_frame_ring_size; i++)
+	{
+		g_frame_ring[i].s_frame = malloc(CH_BYTS * (g_nviz_col * g_nviz_row));
+		g_frame_ring[i].s_frame_index = -1;
+		g_frame_ring[i].s_seek_generation = -1;
+	}
+
+	g_seek_generation = 0;
+	g_seek_pending = 0;
+	g_seek_hold_frame = malloc(CH_BYTS * (g_nviz_col * g_nviz_row));
+
+	// the reader sleeps on this while the ring is full
+	g_reader_wakeup_fd = eventfd(0, EFD_CLOEXEC);
+
+	// a pipe can go quiet in the middle of a frame, the reader is then let go by this instead
+	g_reader_quit_fd = eventfd(0, EFD_CLOEXEC);
+	g_nviz.r_cancel_fd = g_reader_quit_fd;
+
+	// thread
+	g_thread_info.t_running = 1;
+	g_thread_info.t_frame_ring = g_frame_ring;
+	g_thread_info.t_frame_ring_size = g_frame_ring_size;
+	g_thread_info.t_nviz = &g_nviz;
+	g_thread_info.t_nviz_frames = g_nviz_frames;
+	g_thread_info.t_ring_head = 0;
+	g_thread_info.t_ring_released = 0;
+	g_thread_info.t_seek_frame_index = 0;
+	g_thread_info.t_seek_generation = g_seek_generation;
+	g_thread_info.t_wakeup_fd = g_wakeup_fd;
+	g_thread_info.t_wake_renderer = 0;
+	g_thread_info.t_reader_wakeup_fd = g_reader_wakeup_fd;
+	g_thread_info.t_wake_reader = 0;
+	g_thread_info.t_read_nsec = 0;
+	g_thread_info.t_read_frames = 0;
+	g_thread_info.t_ended = 0;
+
+	pthread_attr_init(&g_read_thread_attr);
+	pthread_attr_setstacksize(&g_read_thread_attr, 0x10000000);
+	pthread_create(&g_read_thread_id, &g_read_thread_attr, &read_frames, &g_thread_info);
+
+	// wait for the first frame
+	if (acquire_frame(g_render_frame_index, 1))
+	{
+		deinit_nviz();
+		return 1;
+	}
+
+	return 0;
+}
+
+// start/stop
+void start_stop()
+{
+	g_paused ^= 1;
+
+	reset_schedule();
+}
+
+// toggle looping
+void toggle_looping()
+{
+	g_looping ^= 1;
+}
+
+// increase the rewind/fast forward rate
+void up_rewind_fast_forward_rate()
+{
+	if (g_rewind_fast_forward_rate == 1)
+	{
+		g_rewind_fast_forward_rate = g_nviz_fps;
+	}
+	else if (g_rewind_fast_forward_rate != g_nviz_frames - g_nviz_fps)
+	{
+		g_rewind_fast_forward_rate += g_nviz_fps;
+	}
+}
+
+// decrease the rewind/fast forward rate
+void down_rewind_fast_forward_rate()
+{
+	if (g_rewind_fast_forward_rate == g_nviz_fps)
+	{
+		g_rewind_fast_forward_rate = 1;
+	}
+	else if (g_rewind_fast_forward_rate != 1)
+	{
+		g_rewind_fast_forward_rate -= g_nviz_fps;
+	}
+}
+
+// rewind
+void rewind_nviz()
+{
+	int64_t previous_frame_index = g_render_frame_index;
+
+	// a live stream can only go forward, at the pace it comes in
+	if (g_live)
+	{
+		return;
+	}
+
+	if (g_render_frame_index - g_rewind_fast_forward_rate >= 0)
+	{
+		g_render_frame_index -= g_rewind_fast_forward_rate;
+	}
+	else
+	{
+		g_render_frame_index = 0;
+	}
+
+	if (g_render_frame_index != previous_frame_index)
+	{
+		seek_to_render_frame_index();
+	}
+}
+
+// fast forward
+void fast_forward_nviz()
+{
+	int64_t previous_frame_index = g_render_frame_index;
+
+	if (g_live)
+	{
+		return;
+	}
+
+	if (g_render_frame_index + g_rewind_fast_forward_rate < g_nviz_frames)
+	{
+		g_render_frame_index += g_rewind_fast_forward_rate;
+	}
+	else
+	{
+		g_render_frame_index = g_nviz_frames - 1;
+	}
+
+	if (g_render_frame_index != previous_frame_index)
+	{
+		seek_to_render_frame_index();
+	}
+}
+
+// draw a run of cells that share a color, starting at c
+void draw_run(int r, int c, const char * chrs, int len, char clr)
+{
+	if (g_backend == BACKEND_ANSI)
+	{
+		ansi_text(r, c, chrs, len, clr);
+
+		return;
+	}
+
+	if (g_color_mode)
+	{
+		attron(COLOR_PAIR(clr));
+	}
+
+	mvaddnstr(r, c, chrs, len);
+
+	if (g_color_mode)
+	{
+		attroff(COLOR_PAIR(clr));
+	}
+}
+
+// render
+void render()
+{
+	char run[256];
+
+	int c;
+	int r;
+	for (r = 0; r < g_nviz_row; r++)
+	{
+		const char * frame_row = g_render_frame + CH_BYTS * (g_nviz_col * r);
+		char * drawn_row = g_drawn_frame + CH_BYTS * (g_nviz_col * r);
+
+		// the whole row is unchanged
+		if (g_drawn_frame_valid && memcmp(frame_row, drawn_row, CH_BYTS * g_nviz_col) == 0)
+		{
+			continue;
+		}
+
+		c = 0;
+		while (c < g_nviz_col)
+		{
+			char clr = frame_row[CH_BYTS * c];
+			char chr = frame_row[CH_BYTS * c + 1];
+
+			// skip cells that are already on screen
+			if (g_drawn_frame_valid && clr == drawn_row[CH_BYTS * c] && chr == drawn_row[CH_BYTS * c + 1])
+			{
+				c++;
+				continue;
+			}
+
+			// unprintable characters would cut a run short, the ansi backend draws them as spaces
+			if (!PRINTABLE(chr) && g_backend == BACKEND_NCURSES)
+			{
+				if (g_color_mode)
+				{
+					attron(COLOR_PAIR(clr));
+				}
+
+				mvaddch(r, c, chr);
+
+				if (g_color_mode)
+				{
+					attroff(COLOR_PAIR(clr));
+				}
+
+				c++;
+				continue;
+			}
+
+			// gather the changed cells of the same color into a run
+			int start = c;
+			int len = 0;
+
+			while (c < g_nviz_col && len < (int) sizeof(run))
+			{
+				char run_clr = frame_row[CH_BYTS * c];
+				char run_chr = frame_row[CH_BYTS * c + 1];
+
+				if ((g_color_mode && run_clr != clr) || (!PRINTABLE(run_chr) && g_backend == BACKEND_NCURSES))
+				{
+					break;
+				}
+
+				if (g_drawn_frame_valid && run_clr == drawn_row[CH_BYTS * c] && run_chr == drawn_row[CH_BYTS * c + 1])
+				{
+					break;
+				}
+
+				run[len++] = PRINTABLE(run_chr) ? run_chr : ' ';
+				c++;
+			}
+
+			draw_run(r, start, run, len, clr);
+		}
+
+		memcpy(drawn_row, frame_row, CH_BYTS * g_nviz_col);
+	}
+
+	g_drawn_frame_valid = 1;
+
+	if (!g_hide_panel)
+	{
+		char line[g_col + 1];
+		memset(line, '-', g_col);
+		line[g_col] = 0;
+
+		draw_text(g_row - 7, 0, "%s", line);
+
+		// video info
+		if (g_info_control_panel == 0)
+		{
+			draw_text(g_row - 6, 0, "col x row = %d x %d", g_nviz_col, g_nviz_row);
+			draw_text(g_row - 5, 0, "fps = %d", g_nviz_fps);
+			if (g_live)
+			{
+				draw_text(g_row - 4, 0, "seconds = %lld / live\t", (long long) (g_render_frame_index / g_nviz_fps));
+				draw_text(g_row - 3, 0, "frames = %lld / live\t", (long long) g_render_frame_index);
+			}
+			else
+			{
+				draw_text(g_row - 4, 0, "seconds = %lld / %lld\t", (long long) (g_render_frame_index / g_nviz_fps), (long long) (g_nviz_frames / g_nviz_fps));
+				draw_text(g_row - 3, 0, "frames = %lld / %lld\t", (long long) g_render_frame_index, (long long) (g_nviz_frames - 1));
+			}
+			draw_text(g_row - 1, 0, "file = %s", g_nviz_file_path);
+		}
+
+		// performance
+		if (g_info_control_panel == 2)
+		{
+			draw_text(g_row - 6, 0, "fps = %.1f / %d\t", g_presented_fps, g_nviz_fps);
+			draw_text(g_row - 5, 0, "render = %ld us, %s%ld bytes / frame\t", (long) g_render_usec_per_frame, g_backend == BACKEND_ANSI ? "" : "~", (long) g_render_bytes_per_frame);
+
+			if (g_nviz.r_in_place)
+			{
+				draw_text(g_row - 4, 0, "read = mapped\t");
+				draw_text(g_row - 3, 0, "read ahead = mapped\t");
+			}
+			else
+			{
+				draw_text(g_row - 4, 0, "read = %ld us / frame\t", (long) g_read_usec_per_frame);
+				draw_text(g_row - 3, 0, "read ahead = %d / %d\t", g_read_ahead_frames, g_frame_ring_size - 1);
+			}
+
+			draw_text(g_row - 2, 0, "resident = %ld KB\t", (long) g_resident_kb);
+			draw_text(g_row - 3, g_col / 2 - 12, "presented = %ld\t", (long) g_presented_frames);
+			draw_text(g_row - 2, g_col / 2 - 12, "dropped = %ld, late = %ld\t", (long) g_dropped_frames, (long) g_late_frames);
+		}
+
+		// video controls
+		if (g_info_control_panel == 1)
+		{
+			draw_text(g_row - 6, 0, "s = start/stop");
+			draw_text(g_row - 5, 0, "l = toggle looping");
+			draw_text(g_row - 4, 0, "r = rewind");
+			draw_text(g_row - 3, 0, "f = fast forward");
+			draw_text(g_row - 2, 0, "u = increase rewind/fast forward rate");
+			draw_text(g_row - 1, 0, "d = decrease rewind/fast forward rate");
+		}
+
+		draw_text(g_row - 6, g_col / 2 - 12, "started = %d", !g_paused);
+		draw_text(g_row - 5, g_col / 2 - 12, "looping = %d", g_looping);
+		draw_text(g_row - 4, g_col / 2 - 12, "rewind/fast forward rate = %lld", (long long) g_rewind_fast_forward_rate);
+
+		// general controls
+		draw_text(g_row - 6, g_col - 18, "q = quit nviz");
+		draw_text(g_row - 5, g_col - 18, "i = info panel");
+		draw_text(g_row - 4, g_col - 18, "c = control panel");
+		draw_text(g_row - 3, g_col - 18, "m = perf panel");
+		draw_text(g_row - 2, g_col - 18, "p = toggle panel");
+	}
+}
+
+// compare two int64_t, for qsort
+int compare_int64(const void * a, const void * b)
+{
+	int64_t x = *(const int64_t *) a;
+	int64_t y = *(const int64_t *) b;
+
+	return (x > y) - (x < y);
+}
+
+// the pth percentile of n sorted values
+int64_t percentile(const int64_t * sorted, int64_t n, int p)
+{
+	return sorted[(n - 1) * p / 100];
+}
+
+// play every frame once as fast as possible into the headless target and print what it cost
+void run_benchmark()
+{
+	// a live stream is played until it ends, so its timings grow as they come in
+	int64_t capacity = g_nviz_frames > 0 ? g_nviz_frames : g_nviz_fps;
+	int64_t * render_nsec = malloc(capacity * sizeof(int64_t));
+	int64_t io_wait_nsec = 0;
+
+	// a terminal that fits the frame and the panel
+	g_col = g_nviz_col;
+	g_row = g_nviz_row + 7;
+
+	ansi_init_buffer(g_col, g_row);
+	g_color_mode = 1;
+
+	int64_t start = now_nsec();
+
+	int64_t i;
+	for (i = 0; g_live || i < g_nviz_frames; i++)
+	{
+		int64_t wait_start = now_nsec();
+
+		// init_nviz already waited for the first frame
+		if (i > 0 && acquire_frame(i, 1))
+		{
+			break;
+		}
+
+		if (i == capacity)
+		{
+			capacity *= 2;
+			render_nsec = realloc(render_nsec, capacity * sizeof(int64_t));
+		}
+
+		// a mapped frame is not read until render touches it
+		if (g_nviz.r_in_place)
+		{
+			touch_frame(i);
+		}
+
+		int64_t render_start = now_nsec();
+
+		g_render_frame_index = i;
+
+		render();
+		present_screen();
+
+		int64_t render_end = now_nsec();
+
+		io_wait_nsec += render_start - wait_start;
+		render_nsec[i] = render_end - render_start;
+	}
+
+	int64_t total_nsec = now_nsec() - start;
+	int64_t frames = i;
+
+	qsort(render_nsec, frames, sizeof(int64_t), compare_int64);
+
+	printf("file = %s\n", g_nviz_file_path);
+	printf("col x row = %d x %d\n", g_nviz_col, g_nviz_row);
+	printf("frames = %lld\n", (long long) frames);
+	printf("seconds = %.3f\n", total_nsec / 1e9);
+	printf("frames / second = %.1f\n", frames * 1e9 / total_nsec);
+	printf("render us p50 / p90 / p99 / max = %ld / %ld / %ld / %ld\n",
+		(long) (percentile(render_nsec, frames, 50) / 1000),
+		(long) (percentile(render_nsec, frames, 90) / 1000),
+		(long) (percentile(render_nsec, frames, 99) / 1000),
+		(long) (render_nsec[frames - 1] / 1000));
+	printf("io wait = %ld us, %ld us / frame\n", (long) (io_wait_nsec / 1000), (long) (io_wait_nsec / 1000 / frames));
+	printf("bytes = %ld, %ld / frame\n", (long) g_ansi_bytes, (long) (g_ansi_bytes / frames));
+
+	free(render_nsec);
+	ansi_deinit_buffer();
+}
+
+// main
+int main (int argc, char * argv[])
+{
+	// command line input
+	int opt;
+	while ((opt = getopt(argc, argv, "a:b:Hs:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'a':
+				g_read_ahead = atoi(optarg);
+				break;
+			case 'b':
+				if (strcmp(optarg, "ansi") == 0)
+				{
+					g_backend = BACKEND_ANSI;
+				}
+				else if (strcmp(optarg, "ncurses") != 0)
+				{
+					argc = 0;
+				}
+				break;
+			case 'H':
+				g_ansi_headless = 1;
+				break;
+			case 's':
+				snprintf(g_stats_file_path, sizeof(g_stats_file_path), "%s", optarg);
+				break;
+			default:
+				argc = 0;
+				break;
+		}
+	}
+
+	if (argc - optind != 1)
+	{
+		fprintf(stderr, "ERROR - wrong number of arguments\n");
+		fprintf(stderr, "usage: %s [-a read_ahead_frames] [-b ncurses|ansi] [-H] [-s stats_file] filename\n", argv[0]);
+		return 1;
+	}
+
+	sprintf(g_nviz_file_path, argv[optind]);
+
+	// headless, no terminal is touched and frames are built by the ansi backend
+	if (g_ansi_headless)
+	{
+		g_backend = BACKEND_ANSI;
+
+		if (init_nviz())
+		{
+			fprintf(stderr, "ERROR - could not open %s\n", g_nviz_file_path);
+			return 1;
+		}
+
+		run_benchmark();
+		deinit_nviz();
+
+		return 0;
+	}
+
+	// initialize perf stats first, so a bad stats file path is reported before the screen is taken over
+	if (init_perf_stats())
+	{
+		fprintf(stderr, "ERROR - could not open %s\n", g_stats_file_path);
+		return 1;
+	}
+
+	// initialize the screen
+	init_screen();
+	init_render_stats();
+
+	// initialize nviz
+	if (init_nviz())
+	{
+		deinit_screen();
+		deinit_perf_stats();
+		fprintf(stderr, "ERROR - could not open %s\n", g_nviz_file_path);
+		return 1;
+	}
+
+	struct pollfd fds[3];
+
+	fds[0].fd = STDIN_FILENO;
+	fds[0].events = POLLIN;
+	fds[1].fd = g_timer_fd;
+	fds[1].events = POLLIN;
+	fds[2].fd = g_wakeup_fd;
+	fds[2].events = POLLIN;
+
+	int dirty = 1;
+
+	while (g_running)
+	{
+		// wait for a key, the next frame or a frame the reader thread was asked for
+		// the perf panel and the stats file are refreshed every second, even while paused
+		int timeout = (g_stats_file != NULL || (!g_hide_panel && g_info_control_panel == 2)) ? 1000 : -1;
+
+		if (poll(fds, 3, dirty ? 0 : timeout) < 0 && errno != EINTR)
+		{
+			break;
+		}
+
+		uint64_t expirations;
+
+		if (fds[1].revents & POLLIN)
+		{
+			read(g_timer_fd, &expirations, sizeof(expirations));
+		}
+
+		if (fds[2].revents & POLLIN)
+		{
+			read(g_wakeup_fd, &expirations, sizeof(expirations));
+		}
+
+		// input, every key that is waiting is handled now
+		while ((g_ch = read_key()) != ERR)
+		{
+			dirty = 1;
+
+			switch (g_ch)
+			{
+				case 'q':
+					g_running = 0;
+					break;
+				case 'p':
+					toggle_panel();
+					break;
+				case 'i':
+					set_info_control_panel(0);
+					break;
+				case 'c':
+					set_info_control_panel(1);
+					break;
+				case 'm':
+					set_info_control_panel(2);
+					break;
+				case 's':
+					start_stop();
+					break;
+				case 'l':
+					toggle_looping();
+					break;
+				case 'u':
+					up_rewind_fast_forward_rate();
+					break;
+				case 'd':
+					down_rewind_fast_forward_rate();
+					break;
+				case 'r':
+					rewind_nviz();
+					break;
+				case 'f':
+					fast_forward_nviz();
+					break;
+			}
+		}
+
+		// update
+		int presenting = 0;
+
+		if (finish_seek())
+		{
+			dirty = 1;
+		}
+
+		if (!g_paused && !g_seek_pending)
+		{
+			presenting = schedule_frames();
+
+			if (!g_looping && g_render_frame_index == g_nviz_frames - 1)
+			{
+				g_paused = 1;
+			}
+		}
+
+		// perf stats, the perf panel is redrawn with every new sample
+		if (update_perf_stats() && !g_hide_panel && g_info_control_panel == 2)
+		{
+			dirty = 1;
+		}
+
+		// render, only when something changed
+		if (dirty || presenting)
+		{
+			int64_t render_start = now_nsec();
+
+			render();
+			present_screen();
+
+			int64_t render_end = now_nsec();
+
+			update_render_stats(render_end - render_start);
+
+			if (presenting)
+			{
+				g_presented_frames++;
+
+				// the frame reached the screen after the next one was already due
+				if (!g_live && render_end > frame_deadline(g_play_frames + 1))
+				{
+					g_late_frames++;
+				}
+			}
+		}
+
+		dirty = 0;
+
+		// a paused player sleeps until a key is pressed
+		arm_frame_timer();
+	}
+
 	// deinitialize nviz
 	deinit_nviz();
 
-	// deinitialize ncurses
-	deinit_ncurses();
+	// deinitialize the screen
+	deinit_render_stats();
+	deinit_perf_stats();
+	deinit_screen();
 
 	return 0;
 }
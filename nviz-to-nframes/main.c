@@ -1,111 +1,158 @@
 // nviz-to-nframes - a simple program that converts .nviz video/visual files to .nframe ascii art files
 // made by Nikola Whallon (https://github.com/nikolawhallon/nviz-project, nikola.whallon@gmail.com)
 
+#define _FILE_OFFSET_BITS 64
+
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "nviz.h"
+#include "pool.h"
 
-#define NVIZ_HD 5
-#define CH_BYTS 2
-#define MAX_COL 250
-#define MAX_ROW 75
+#define WRITER_THREADS 4			// creating files waits on the disk, not the cpu, so a few more than one help
 
 //----------------------------------------------------				// GLOBAL VARIABLES
 
 // nviz
 char g_nviz_file_path[256];
-int g_nviz_col;
-int g_nviz_row;
-int g_nviz_fps;
-int g_nviz_sec;
+nviz_reader g_nviz;
 
 // nframe
 char g_nframe_files_base_path[256];
-char g_frame[CH_BYTS * (MAX_COL * MAX_ROW)];
-int g_nframe_col;
-int g_nframe_row;
+int g_archive;					// bool, every frame goes into one .nframes archive at g_nframe_files_base_path
+
+// writer pool, the writers take the frames in the order they are read
+int g_threads = WRITER_THREADS;
 
 //----------------------------------------------------				// FUNCTIONS
 
-int init_nviz()
+// writer thread, writes the frames the pool hands it until the reader is done
+void * write_nframes(void * arg)
 {
-	// declare and open the nviz file
-	FILE * nviz_file = fopen(g_nviz_file_path, "rb");
+	nviz_pool * pool = arg;
+	nviz_pool_slot * slot;
 
-	// check that the file could be opened
-	if (nviz_file == NULL)
+	while ((slot = nviz_pool_take(pool)) != NULL)
 	{
-		return 1;
+		// room for the whole base path, the frame number and the extension
+		char nframe_file_path[512];
+		snprintf(nframe_file_path, sizeof(nframe_file_path), "%s%lld.nframe", g_nframe_files_base_path, (long long) slot->s_index);
+
+		if (nframe_write(nframe_file_path, g_nviz.r_header.h_col, g_nviz.r_header.h_row, slot->s_frame) && nviz_pool_fail(pool))
+		{
+			fprintf(stderr, "ERROR - unable to write %s\n", nframe_file_path);
+		}
+
+		nviz_pool_release(pool, slot);
 	}
 
-	// calculate the file size
-	fseek(nviz_file, 0, SEEK_END);
-	int32_t file_size = ftell(nviz_file);
-	fseek(nviz_file, 0, SEEK_SET);
+	return NULL;
+}
 
-	// check that the file contains the nviz info
-	if (file_size < NVIZ_HD)
+// write every frame into one archive, in order, returns 1 if it could not be written
+int write_archive()
+{
+	nframes_writer archive;
+
+	if (nframes_create(&archive, g_nframe_files_base_path))
 	{
-		fclose(nviz_file);
+		fprintf(stderr, "ERROR - unable to create %s\n", g_nframe_files_base_path);
 		return 1;
 	}
 
-	// input the nviz info
-	fread(&g_nviz_col, 1, 1, nviz_file);
-	fread(&g_nviz_row, 1, 1, nviz_file);
-	fread(&g_nviz_fps, 1, 1, nviz_file);
-	fread(&g_nviz_sec, 2, 1, nviz_file);
+	nviz_iter it;
+	nviz_iter_init(&it, &g_nviz);
+
+	int failed = 0;
 
-	// check that the file contains the nviz data
-	if (file_size < NVIZ_HD + CH_BYTS * (g_nviz_col * g_nviz_row) * g_nviz_fps * g_nviz_sec)
+	while (!failed && nviz_iter_next(&it))
 	{
-		fclose(nviz_file);
-		return 1;
+		failed = nframes_write_frame(&archive, g_nviz.r_header.h_col, g_nviz.r_header.h_row, it.i_frame);
+	}
+
+	// the iterator stops on a frame it cannot read too, only a live stream has no known end
+	int unread = !failed && g_nviz.r_frames > 0 && it.i_index < g_nviz.r_frames;
+
+	if (unread)
+	{
+		fprintf(stderr, "ERROR - unable to read frame %lld of %s\n", (long long) it.i_index, g_nviz_file_path);
 	}
 
-	// close the nviz file
-	fclose(nviz_file);
+	if (nframes_finish(&archive))
+	{
+		failed = 1;
+	}
+
+	if (failed)
+	{
+		fprintf(stderr, "ERROR - unable to write %s\n", g_nframe_files_base_path);
+	}
+
+	return failed || unread;
 }
 
 int main(int argc, char * argv[])
 {
+	// command line options
+	int opt;
+	while ((opt = getopt(argc, argv, "aj:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'a':
+				g_archive = 1;
+				break;
+			case 'j':
+				g_threads = atoi(optarg);
+				break;
+			default:
+				argc = 0;
+				break;
+		}
+	}
+
 	// command line input
-	if (argc != 3)
+	if (argc - optind != 2 || g_threads < 1)
 	{
 		fprintf(stderr, "ERROR - wrong number of arguments\n");
-		fprintf(stderr, "usage: %s in_file_path out_files_base_path\n", argv[0]);
+		fprintf(stderr, "usage: %s [-a] [-j threads] in_file_path out_files_base_path\n", argv[0]);
 		return 1;
 	}
 
+	argv += optind - 1;
+
 	sprintf(g_nviz_file_path, argv[1]);
 	sprintf(g_nframe_files_base_path, argv[2]);
 
-	if (init_nviz())
+	if (nviz_open(&g_nviz, g_nviz_file_path))
 	{
 		fprintf(stderr, "ERROR - unable to open %s\n", g_nviz_file_path);
 		return 1;
 	}
 
-	int32_t f;
-	for (f = 0; f < g_nviz_fps * g_nviz_sec; f++)
+	// an archive is one file written front to back, the writer pool is for separate files
+	if (g_archive)
 	{
-		FILE * nviz_file = fopen(g_nviz_file_path, "rb");
-
-		fseek(nviz_file, NVIZ_HD + CH_BYTS * (g_nviz_col * g_nviz_row) * f, SEEK_SET);
-		fread(g_frame, 1, CH_BYTS * (g_nviz_col * g_nviz_row), nviz_file);
-
-		fclose(nviz_file);
+		int failed = write_archive();
 
-		char nframe_file_path[256];
-		sprintf(nframe_file_path, "%s%d.nframe", g_nframe_files_base_path, f);
+		nviz_close(&g_nviz);
 
-		FILE * nframe_file = fopen(nframe_file_path, "wb");
+		return failed;
+	}
 
-		fwrite(&g_nviz_col, 1, 1, nframe_file);
-		fwrite(&g_nviz_row, 1, 1, nframe_file);
-		fwrite(&g_frame, 1, CH_BYTS * (g_nviz_col * g_nviz_row), nframe_file);
+	// the input is read once, front to back, whether it is mapped, read, decoded or piped
+	nviz_pool pool;
+	int failed = nviz_pool_run(&pool, &g_nviz, g_threads, &write_nframes, 0, -1);
 
-		fclose(nframe_file);
+	if (pool.p_unread_frame >= 0)
+	{
+		fprintf(stderr, "ERROR - unable to read frame %lld of %s\n", (long long) pool.p_unread_frame, g_nviz_file_path);
 	}
 
-	return 0;
+	nviz_close(&g_nviz);
+
+	return failed;
 }
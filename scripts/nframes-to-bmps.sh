@@ -1,5 +1,8 @@
 #! /bin/bash
 
+# converts a run of .nframe files, one nframe-to-bmp process each
+# for a .nviz, nframe-to-bmp [-f first_number] [-l last_number] nviz_file_path bmp_files_base_path converts every frame in one process
+
 if [ "$#" -ne 4 ]; then
 echo "wrong number of arguments"
 echo "usage: nframes_to_bmps nframe_files_base_path bmp_files_base_path first_number last_number"
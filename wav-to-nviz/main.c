@@ -1,61 +1,1391 @@
 // wav-to-nviz - a program that converts .wav audio files to .nviz visual files of the waveform of the audio
 // made by Nikola Whallon (https://github.com/nikolawhallon/nviz-project, nikola.whallon@gmail.com)
 
+#define _FILE_OFFSET_BITS 64
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
 #include <math.h>
 #include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+
+#include "nviz.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_KERNELS
+#endif
+
+#define MEASURE_SAMPLE 0			// the first sample of each frame window
+#define MEASURE_PEAK 1				// the largest magnitude in the window
+#define MEASURE_RMS 2				// the root mean square of the window
+
+#define VISUAL_WAVE 0				// the scrolling amplitude bar of each channel
+#define VISUAL_SPECTRUM 1			// a bar per column for its frequency band
+#define VISUAL_SPECTROGRAM 2			// a row per frame, scrolling, shaded by the level of each band
+
+#define WAVE_FORMAT_PCM 0x0001
+#define WAVE_FORMAT_IEEE_FLOAT 0x0003
+#define WAVE_FORMAT_EXTENSIBLE 0xfffe
+
+#define SPECTRUM_MIN_HZ 20.0
+#define SPECTRUM_RANGE_DB 60.0			// levels this far below full scale are silent
+
+#define STREAM_BUFFER_MS 10			// default input a stream may fall behind by before windows are skipped
+
+typedef struct {
+	char * b_data;				// raw bytes of the window, only used when the file is not mapped
+	size_t b_size;
+	float * b_left;				// decoded channels of the window, from -1 to 1
+	float * b_right;
+	uint32_t b_samples;
+} window_buffer;
+
+typedef struct {
+	int p_size;				// fft size, a power of two
+	int p_window_len;			// samples in a frame window, zero padded up to p_size
+	int p_bands;				// one band per column
+	int * p_bit_reverse;
+	float * p_cos;				// twiddles, p_size / 2 of each
+	float * p_sin;
+	float * p_window;			// hann window over p_window_len
+	int * p_band_start;			// first fft bin of each band, p_bands + 1 entries
+	float p_scale;				// magnitude of a full scale sine
+} fft_plan;
+
+typedef struct {
+	int64_t t_first_frame;
+	int64_t t_last_frame;			// one past the last frame
+	uint64_t t_samples;			// samples in the data chunk
+	uint8_t * t_levels;			// p_bands levels per frame, 0 to 255
+	int t_failed;				// a window could not be read
+} spectrum_task;
+
+typedef struct {
+	int64_t t_first_frame;
+	int64_t t_last_frame;			// one past the last frame
+	uint32_t t_samples_per_frame;
+	uint64_t t_samples;			// samples in the data chunk
+	int t_col;
+	int t_row;
+	char t_color;
+	nviz_writer * t_nviz;
+	float * t_levels;			// when set, the frames are only measured, left and right amplitude of each
+	int t_failed;
+} wave_task;
+
+typedef struct {
+	char * h_rows;				// h_row rows of h_col cells, the oldest at h_head
+	int h_head;
+	int h_col;
+	int h_row;
+} wave_history;
+
+//----------------------------------------------------				// GLOBAL VARIABLES
+
+// wav reader, the data chunk is mapped when possible and read in windows otherwise
+int g_wav_fd = -1;
+char * g_wav_map;				// whole file mapping, NULL when falling back to reads
+size_t g_wav_map_size;
+off_t g_wav_data_offset;			// where the data chunk starts in the file
+uint64_t g_wav_data_size;
+window_buffer g_wav_window;			// used by the main thread
+
+// wav format, every format is decoded to floats from -1 to 1
+int g_wav_channels;
+int g_wav_sample_bytes;
+int g_wav_block_align;				// bytes per sample of all channels
+void (* g_decode)(const char * samples, uint32_t count, int stride, float * out);
+const char * g_decode_name;
+
+// amplitude measurement
+int g_measure = MEASURE_SAMPLE;
+void (* g_measure_window)(const float * samples, uint32_t count, float * peak, double * sum_sq);
+const char * g_measure_kernel_name;
+
+// random characters, every frame has its own stream so frames can be made in any order
+uint64_t g_seed;
+
+// visualization
+int g_visual = VISUAL_WAVE;
+int g_threads;					// 0 means one per cpu, used by spectrum and waveform alike
+fft_plan g_fft_plan;				// built once, shared by every spectrum thread
+
+// streaming, samples are read from a pipe as they come in and each frame is written as soon as its window is complete
+int g_stream_buffer_ms = STREAM_BUFFER_MS;
+int g_nviz_version = NVIZ_VERSION_RAW;		// NVIZ_VERSION_DELTA writes keyframes and deltas
+int64_t g_stream_dropped;			// windows skipped to catch up with the input
+
+//----------------------------------------------------				// FUNCTIONS
+
+// initialize an empty window buffer
+void init_window_buffer(window_buffer * wb)
+{
+	wb->b_data = NULL;
+	wb->b_size = 0;
+	wb->b_left = NULL;
+	wb->b_right = NULL;
+	wb->b_samples = 0;
+}
+
+// free a window buffer
+void deinit_window_buffer(window_buffer * wb)
+{
+	free(wb->b_data);
+	free(wb->b_left);
+	free(wb->b_right);
+}
+
+// make room for count decoded samples of each channel
+void reserve_window_channels(window_buffer * wb, uint32_t count)
+{
+	if (count <= wb->b_samples)
+	{
+		return;
+	}
+
+	free(wb->b_left);
+	free(wb->b_right);
+
+	wb->b_samples = count;
+	wb->b_left = malloc(count * sizeof(float));
+	wb->b_right = malloc(count * sizeof(float));
+}
+
+// decoders, count samples that are stride bytes apart to floats from -1 to 1
+void decode_u8(const char * samples, uint32_t count, int stride, float * out)
+{
+	const unsigned char * s = (const unsigned char *) samples;
+
+	uint32_t i;
+	for (i = 0; i < count; i++)
+	{
+		out[i] = (s[(size_t) i * stride] - 128) * (1.0f / 128);
+	}
+}
+
+void decode_s16(const char * samples, uint32_t count, int stride, float * out)
+{
+	uint32_t i;
+	for (i = 0; i < count; i++)
+	{
+		int16_t v;
+		memcpy(&v, samples + (size_t) i * stride, 2);
+
+		out[i] = v * (1.0f / 32768);
+	}
+}
+
+// packed 16 bit stereo is by far the most common, a fixed stride lets the compiler vectorize it
+// stride is always 4, it is only there to fit g_decode
+void decode_s16_stereo(const char * samples, uint32_t count, int stride, float * out)
+{
+	(void) stride;
+
+	uint32_t i;
+	for (i = 0; i < count; i++)
+	{
+		int16_t v;
+		memcpy(&v, samples + (size_t) i * 4, 2);
+
+		out[i] = v * (1.0f / 32768);
+	}
+}
+
+void decode_s24(const char * samples, uint32_t count, int stride, float * out)
+{
+	const unsigned char * s = (const unsigned char *) samples;
+
+	uint32_t i;
+	for (i = 0; i < count; i++)
+	{
+		const unsigned char * b = s + (size_t) i * stride;
+
+		// the third byte goes to the top so that the shift back down extends the sign
+		int32_t v = (int32_t) ((uint32_t) b[0] << 8 | (uint32_t) b[1] << 16 | (uint32_t) b[2] << 24) >> 8;
+
+		out[i] = v * (1.0f / 8388608);
+	}
+}
+
+void decode_s32(const char * samples, uint32_t count, int stride, float * out)
+{
+	uint32_t i;
+	for (i = 0; i < count; i++)
+	{
+		int32_t v;
+		memcpy(&v, samples + (size_t) i * stride, 4);
+
+		out[i] = v * (1.0f / 2147483648.0f);
+	}
+}
+
+void decode_f32(const char * samples, uint32_t count, int stride, float * out)
+{
+	uint32_t i;
+	for (i = 0; i < count; i++)
+	{
+		memcpy(&out[i], samples + (size_t) i * stride, 4);
+	}
+}
+
+void decode_f64(const char * samples, uint32_t count, int stride, float * out)
+{
+	uint32_t i;
+	for (i = 0; i < count; i++)
+	{
+		double v;
+		memcpy(&v, samples + (size_t) i * stride, 8);
+
+		out[i] = v;
+	}
+}
+
+// pick the decoder for the format, returns 1 if it is not supported
+int init_wav_format(uint16_t format, uint16_t channels, uint16_t bits_per_sample, uint16_t block_align)
+{
+	g_wav_channels = channels;
+	g_wav_sample_bytes = bits_per_sample / 8;
+	g_wav_block_align = block_align;
+
+	if (channels == 0 || bits_per_sample % 8 != 0 || block_align != channels * g_wav_sample_bytes)
+	{
+		return 1;
+	}
+
+	g_decode = NULL;
+
+	if (format == WAVE_FORMAT_PCM)
+	{
+		switch (bits_per_sample)
+		{
+			case 8:
+				g_decode = decode_u8;
+				g_decode_name = "8 bit unsigned";
+				break;
+			case 16:
+				g_decode = channels == 2 ? decode_s16_stereo : decode_s16;
+				g_decode_name = "16 bit signed";
+				break;
+			case 24:
+				g_decode = decode_s24;
+				g_decode_name = "24 bit signed";
+				break;
+			case 32:
+				g_decode = decode_s32;
+				g_decode_name = "32 bit signed";
+				break;
+		}
+	}
+	else if (format == WAVE_FORMAT_IEEE_FLOAT)
+	{
+		switch (bits_per_sample)
+		{
+			case 32:
+				g_decode = decode_f32;
+				g_decode_name = "32 bit float";
+				break;
+			case 64:
+				g_decode = decode_f64;
+				g_decode_name = "64 bit float";
+				break;
+		}
+	}
+
+	return g_decode == NULL;
+}
+
+// pick the decoder for raw samples named like u8, s16, s24, s32, f32 or f64, returns 1 if the name is unknown
+int init_raw_format(const char * name, uint16_t channels)
+{
+	uint16_t format = name[0] == 'f' ? WAVE_FORMAT_IEEE_FLOAT : WAVE_FORMAT_PCM;
+	uint16_t bits = atoi(name + 1);
+
+	if ((name[0] != 'u' || bits != 8) && (name[0] != 's' || bits == 8) && name[0] != 'f')
+	{
+		return 1;
+	}
+
+	return init_wav_format(format, channels, bits, channels * (bits / 8));
+}
+
+// decode one channel of count samples of a window into out
+void decode_channel(const char * window, uint32_t count, int channel, float * out)
+{
+	g_decode(window + channel * g_wav_sample_bytes, count, g_wav_block_align, out);
+}
+
+// open the wav file for reading the data chunk, returns 1 if it could not be opened
+int init_wav_reader(const char * wav_file_path, off_t data_offset, uint64_t data_size)
+{
+	g_wav_fd = open(wav_file_path, O_RDONLY);
+
+	if (g_wav_fd < 0)
+	{
+		return 1;
+	}
+
+	g_wav_data_offset = data_offset;
+	g_wav_data_size = data_size;
+	init_window_buffer(&g_wav_window);
+
+	// map the whole file, windows are then decoded straight out of the page cache
+	// a file bigger than the address space, on a 32 bit build, is read instead
+	struct stat st;
+
+	if (fstat(g_wav_fd, &st))
+	{
+		close(g_wav_fd);
+		return 1;
+	}
+
+	g_wav_map = NULL;
+
+	if ((uint64_t) st.st_size <= SIZE_MAX)
+	{
+		g_wav_map_size = st.st_size;
+		g_wav_map = mmap(NULL, g_wav_map_size, PROT_READ, MAP_SHARED, g_wav_fd, 0);
+
+		if (g_wav_map == MAP_FAILED)
+		{
+			g_wav_map = NULL;
+		}
+		else
+		{
+			madvise(g_wav_map, g_wav_map_size, MADV_SEQUENTIAL);
+		}
+	}
 
-#define MAX_COL 200
-#define MAX_ROW 100
-#define CH_BYTS 2
+	return 0;
+}
+
+// close the wav file
+void deinit_wav_reader()
+{
+	if (g_wav_map != NULL)
+	{
+		munmap(g_wav_map, g_wav_map_size);
+	}
+
+	deinit_window_buffer(&g_wav_window);
+
+	close(g_wav_fd);
+}
+
+// len bytes of the data chunk starting at off, NULL if they could not be read
+// when the file is not mapped they are read into wb, so every thread needs its own
+const char * read_wav_window(window_buffer * wb, uint64_t off, size_t len)
+{
+	if (g_wav_map != NULL)
+	{
+		return g_wav_map + g_wav_data_offset + off;
+	}
+
+	if (len > wb->b_size)
+	{
+		free(wb->b_data);
+
+		wb->b_size = len;
+		wb->b_data = malloc(wb->b_size);
+	}
+
+	size_t done = 0;
+
+	while (done < len)
+	{
+		ssize_t n = pread(g_wav_fd, wb->b_data + done, len - done, g_wav_data_offset + off + done);
+
+		if (n < 0 && errno == EINTR)
+		{
+			continue;
+		}
+
+		if (n <= 0)
+		{
+			return NULL;
+		}
+
+		done += n;
+	}
+
+	return wb->b_data;
+}
+
+// peak magnitude and sum of squares of count samples, one at a time
+// the squares are summed as doubles, which is exact for every integer format up to 24 bit
+void measure_window_scalar(const float * samples, uint32_t count, float * peak, double * sum_sq)
+{
+	float p = 0;
+	double s = 0;
+
+	uint32_t i;
+	for (i = 0; i < count; i++)
+	{
+		float mag = fabsf(samples[i]);
+
+		p = mag > p ? mag : p;
+		s += (double) samples[i] * samples[i];
+	}
+
+	*peak = p;
+	*sum_sq = s;
+}
+
+#ifdef HAVE_X86_KERNELS
+// peak magnitude and sum of squares, four samples at a time
+__attribute__((target("sse2")))
+void measure_window_sse2(const float * samples, uint32_t count, float * peak, double * sum_sq)
+{
+	const __m128 sign = _mm_set1_ps(-0.0f);
+
+	__m128 p = _mm_setzero_ps();
+	__m128d s_lo = _mm_setzero_pd();
+	__m128d s_hi = _mm_setzero_pd();
+
+	uint32_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 v = _mm_loadu_ps(samples + i);
+
+		p = _mm_max_ps(p, _mm_andnot_ps(sign, v));
+
+		__m128d lo = _mm_cvtps_pd(v);
+		__m128d hi = _mm_cvtps_pd(_mm_movehl_ps(v, v));
+
+		s_lo = _mm_add_pd(s_lo, _mm_mul_pd(lo, lo));
+		s_hi = _mm_add_pd(s_hi, _mm_mul_pd(hi, hi));
+	}
+
+	float peaks[4];
+	double sums[2];
+
+	_mm_storeu_ps(peaks, p);
+	_mm_storeu_pd(sums, _mm_add_pd(s_lo, s_hi));
+
+	// the samples that do not fill a vector
+	measure_window_scalar(samples + i, count - i, peak, sum_sq);
+
+	int j;
+	for (j = 0; j < 4; j++)
+	{
+		*peak = peaks[j] > *peak ? peaks[j] : *peak;
+	}
+
+	*sum_sq += sums[0] + sums[1];
+}
+
+// peak magnitude and sum of squares, eight samples at a time
+__attribute__((target("avx2")))
+void measure_window_avx2(const float * samples, uint32_t count, float * peak, double * sum_sq)
+{
+	const __m256 sign = _mm256_set1_ps(-0.0f);
+
+	__m256 p = _mm256_setzero_ps();
+	__m256d s_lo = _mm256_setzero_pd();
+	__m256d s_hi = _mm256_setzero_pd();
+
+	uint32_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256 v = _mm256_loadu_ps(samples + i);
+
+		p = _mm256_max_ps(p, _mm256_andnot_ps(sign, v));
+
+		__m256d lo = _mm256_cvtps_pd(_mm256_castps256_ps128(v));
+		__m256d hi = _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1));
+
+		s_lo = _mm256_add_pd(s_lo, _mm256_mul_pd(lo, lo));
+		s_hi = _mm256_add_pd(s_hi, _mm256_mul_pd(hi, hi));
+	}
+
+	float peaks[8];
+	double sums[4];
+
+	_mm256_storeu_ps(peaks, p);
+	_mm256_storeu_pd(sums, _mm256_add_pd(s_lo, s_hi));
+
+	measure_window_scalar(samples + i, count - i, peak, sum_sq);
+
+	int j;
+	for (j = 0; j < 8; j++)
+	{
+		*peak = peaks[j] > *peak ? peaks[j] : *peak;
+	}
+
+	*sum_sq += sums[0] + sums[1] + sums[2] + sums[3];
+}
+#endif
+
+// pick the measurement kernel, auto takes the widest one the cpu supports, returns 1 if the name is unknown or unsupported
+int init_measure_kernel(const char * name)
+{
+	int want_auto = strcmp(name, "auto") == 0;
+
+#ifdef HAVE_X86_KERNELS
+	__builtin_cpu_init();
+
+	if ((want_auto || strcmp(name, "avx2") == 0) && __builtin_cpu_supports("avx2"))
+	{
+		g_measure_window = measure_window_avx2;
+		g_measure_kernel_name = "avx2";
+		return 0;
+	}
+
+	if ((want_auto || strcmp(name, "sse2") == 0) && __builtin_cpu_supports("sse2"))
+	{
+		g_measure_window = measure_window_sse2;
+		g_measure_kernel_name = "sse2";
+		return 0;
+	}
+#endif
+
+	if (want_auto || strcmp(name, "scalar") == 0)
+	{
+		g_measure_window = measure_window_scalar;
+		g_measure_kernel_name = "scalar";
+		return 0;
+	}
+
+	return 1;
+}
+
+// splitmix64, spreads a seed over all 64 bits
+static inline uint64_t mix_seed(uint64_t x)
+{
+	x += 0x9e3779b97f4a7c15ULL;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+
+	return x ^ (x >> 31);
+}
+
+// the start of a frame's random stream, it only depends on the seed and the frame index
+uint64_t frame_random_state(int64_t frame_index)
+{
+	uint64_t state = mix_seed(g_seed ^ mix_seed(frame_index));
+
+	return state != 0 ? state : 1;
+}
+
+// xorshift64*, 64 random bits per step
+static inline uint64_t xorshift64(uint64_t * state)
+{
+	uint64_t x = *state;
+
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+
+	*state = x;
+
+	return x * 0x2545f4914f6cdd1dULL;
+}
+
+// give every drawn cell a random printable character, eight cells per step
+void randomize_chars(char * frame, int cells, uint64_t * state)
+{
+	int i = 0;
+
+	while (i < cells)
+	{
+		uint64_t bits = xorshift64(state);
+
+		int j;
+		for (j = 0; j < 8 && i < cells; j++, i++)
+		{
+			char * chr = frame + CH_BYTS * i + 1;
+			char random = 32 + ((((bits >> (8 * j)) & 0xff) * 95) >> 8);
+
+			*chr = *chr == ' ' ? ' ' : random;
+		}
+	}
+}
+
+// the amplitude of each channel of count samples of a window, 0 to 1
+// the first two channels are left and right, a mono file shows its one channel on both sides
+void measure_samples(window_buffer * wb, const char * window, uint32_t count, float * lpercent, float * rpercent)
+{
+	reserve_window_channels(wb, count);
+
+	decode_channel(window, count, 0, wb->b_left);
+	decode_channel(window, count, g_wav_channels > 1 ? 1 : 0, wb->b_right);
+
+	if (g_measure == MEASURE_SAMPLE)
+	{
+		*lpercent = fabsf(wb->b_left[0]);
+		*rpercent = fabsf(wb->b_right[0]);
+	}
+	else
+	{
+		float l_peak;
+		float r_peak;
+		double l_sum_sq;
+		double r_sum_sq;
+
+		g_measure_window(wb->b_left, count, &l_peak, &l_sum_sq);
+		g_measure_window(wb->b_right, count, &r_peak, &r_sum_sq);
+
+		if (g_measure == MEASURE_PEAK)
+		{
+			*lpercent = l_peak;
+			*rpercent = r_peak;
+		}
+		else
+		{
+			*lpercent = sqrt(l_sum_sq / count);
+			*rpercent = sqrt(r_sum_sq / count);
+		}
+	}
+
+	// float files can go past full scale
+	*lpercent = *lpercent < 1 ? *lpercent : 1;
+	*rpercent = *rpercent < 1 ? *rpercent : 1;
+}
+
+// the amplitude of each channel for a frame, 0 to 1, returns 1 if its window could not be read
+int measure_frame(window_buffer * wb, int64_t frame_index, uint32_t samples_per_frame, uint64_t samples, float * lpercent, float * rpercent)
+{
+	// sample mode only needs the first sample of the window, so it jumps straight to it
+	uint64_t first = frame_index * samples_per_frame;
+	uint32_t count = g_measure == MEASURE_SAMPLE ? 1 : samples_per_frame;
+
+	if (first + count > samples)
+	{
+		count = samples - first;
+	}
+
+	const char * window = read_wav_window(wb, first * g_wav_block_align, (size_t) count * g_wav_block_align);
+
+	if (window == NULL)
+	{
+		return 1;
+	}
+
+	measure_samples(wb, window, count, lpercent, rpercent);
+
+	return 0;
+}
+
+// initialize an empty waveform history
+void init_wave_history(wave_history * wh, int col, int row)
+{
+	wh->h_rows = malloc(CH_BYTS * col * row);
+	wh->h_head = 0;
+	wh->h_col = col;
+	wh->h_row = row;
+
+	int i;
+	for (i = 0; i < col * row; i++)
+	{
+		wh->h_rows[CH_BYTS * i] = 0;
+		wh->h_rows[CH_BYTS * i + 1] = ' ';
+	}
+}
+
+// free a waveform history
+void deinit_wave_history(wave_history * wh)
+{
+	free(wh->h_rows);
+}
+
+// add the newest row, it replaces the oldest one
+void push_wave_row(wave_history * wh, float lpercent, float rpercent, char color)
+{
+	int col = wh->h_col;
+	char * cells = wh->h_rows + CH_BYTS * col * wh->h_head;
+
+	// the left channel grows left from the middle, the right channel grows right
+	int lamp = (int) (col / 2 * lpercent);
+	int ramp = (int) (col / 2 * rpercent);
+
+	int c;
+	for (c = 0; c < col; c++)
+	{
+		int drawn = c >= col / 2 - lamp && c < col / 2 + ramp;
+
+		cells[CH_BYTS * c] = drawn ? color : 0;
+		cells[CH_BYTS * c + 1] = drawn ? '*' : ' ';
+	}
+
+	wh->h_head = (wh->h_head + 1) % wh->h_row;
+}
+
+// copy the history into a frame, oldest row at the top, in at most two pieces
+void assemble_wave_frame(const wave_history * wh, char * frame)
+{
+	size_t row_bytes = CH_BYTS * wh->h_col;
+	size_t older_bytes = (wh->h_row - wh->h_head) * row_bytes;
+
+	memcpy(frame, wh->h_rows + wh->h_head * row_bytes, older_bytes);
+	memcpy(frame + older_bytes, wh->h_rows, wh->h_head * row_bytes);
+}
+
+// how many threads to split fno frames over
+int thread_count(int64_t fno)
+{
+	int threads = g_threads > 0 ? g_threads : sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (threads > fno)
+	{
+		threads = fno;
+	}
+
+	return threads < 1 ? 1 : threads;
+}
+
+// waveform thread, makes a segment of frames and writes them where they go in the file
+static void * wave_frames(void * param)
+{
+	wave_task * wt = (wave_task *) param;
+
+	// compressed frames have to be written in order, so the threads only measure them
+	if (wt->t_levels != NULL)
+	{
+		window_buffer wb;
+		init_window_buffer(&wb);
+
+		int64_t f;
+		for (f = wt->t_first_frame; f < wt->t_last_frame; f++)
+		{
+			if (measure_frame(&wb, f, wt->t_samples_per_frame, wt->t_samples, &wt->t_levels[2 * f], &wt->t_levels[2 * f + 1]))
+			{
+				wt->t_failed = 1;
+				break;
+			}
+		}
+
+		deinit_window_buffer(&wb);
+
+		return NULL;
+	}
+
+	size_t frame_bytes = CH_BYTS * wt->t_col * wt->t_row;
+	int batch = NVIZ_WRITE_BUFFER / frame_bytes > 0 ? NVIZ_WRITE_BUFFER / frame_bytes : 1;
+	char * out = malloc(batch * frame_bytes);
+	window_buffer wb;
+	wave_history wh;
+
+	init_window_buffer(&wb);
+
+	init_wave_history(&wh, wt->t_col, wt->t_row);
+
+	// the rows of the frames before the segment are still on screen in its first frame, so they are measured first
+	int64_t f = wt->t_first_frame - (wt->t_row - 1);
+
+	if (f < 0)
+	{
+		f = 0;
+	}
+
+	int64_t batch_first = wt->t_first_frame;
+
+	for (; f < wt->t_last_frame; f++)
+	{
+		float lpercent;
+		float rpercent;
+
+		if (measure_frame(&wb, f, wt->t_samples_per_frame, wt->t_samples, &lpercent, &rpercent))
+		{
+			wt->t_failed = 1;
+			break;
+		}
+
+		push_wave_row(&wh, lpercent, rpercent, wt->t_color);
+
+		if (f < wt->t_first_frame)
+		{
+			continue;
+		}
+
+		// every drawn cell of the history flickers to a new character each frame
+		char * frame = out + (f - batch_first) * frame_bytes;
+		uint64_t random_state = frame_random_state(f);
+
+		assemble_wave_frame(&wh, frame);
+		randomize_chars(frame, wt->t_col * wt->t_row, &random_state);
+
+		if (f - batch_first + 1 == batch || f == wt->t_last_frame - 1)
+		{
+			if (nviz_write_frames_at(wt->t_nviz, batch_first, out, f - batch_first + 1))
+			{
+				wt->t_failed = 1;
+				break;
+			}
+
+			batch_first = f + 1;
+		}
+	}
+
+	deinit_wave_history(&wh);
+	deinit_window_buffer(&wb);
+	free(out);
+
+	return NULL;
+}
+
+// convert fno frames of waveform, split into a segment per thread, returns 1 if the wav data could not be read or the frames written
+// a frame only depends on the last row amplitudes and its own random stream, so any split gives the same file
+int convert_wave(nviz_writer * nviz, int col, int row, char color, int64_t fno, uint32_t samples_per_frame, uint64_t samples)
+{
+	int threads = thread_count(fno);
+	float * levels = nviz->w_header.h_version == NVIZ_VERSION_DELTA ? malloc((size_t) fno * 2 * sizeof(float)) : NULL;
+	wave_task * tasks = malloc(threads * sizeof(wave_task));
+	pthread_t * ids = malloc(threads * sizeof(pthread_t));
+	int failed = 0;
+
+	int t;
+	for (t = 0; t < threads; t++)
+	{
+		tasks[t].t_first_frame = (int64_t) fno * t / threads;
+		tasks[t].t_last_frame = (int64_t) fno * (t + 1) / threads;
+		tasks[t].t_samples_per_frame = samples_per_frame;
+		tasks[t].t_samples = samples;
+		tasks[t].t_col = col;
+		tasks[t].t_row = row;
+		tasks[t].t_color = color;
+		tasks[t].t_nviz = nviz;
+		tasks[t].t_levels = levels;
+		tasks[t].t_failed = 0;
+
+		pthread_create(&ids[t], NULL, &wave_frames, &tasks[t]);
+	}
+
+	for (t = 0; t < threads; t++)
+	{
+		pthread_join(ids[t], NULL);
+
+		failed |= tasks[t].t_failed;
+	}
+
+	// the measured frames are drawn and written in order, like the spectrum
+	if (levels != NULL)
+	{
+		char * frame = malloc(CH_BYTS * col * row);
+		wave_history wh;
+
+		init_wave_history(&wh, col, row);
+
+		int64_t f;
+		for (f = 0; f < fno && !failed; f++)
+		{
+			uint64_t random_state = frame_random_state(f);
+
+			push_wave_row(&wh, levels[2 * f], levels[2 * f + 1], color);
+			assemble_wave_frame(&wh, frame);
+			randomize_chars(frame, col * row, &random_state);
+
+			failed = nviz_write_frame(nviz, frame);
+		}
+
+		deinit_wave_history(&wh);
+		free(frame);
+		free(levels);
+	}
+
+	free(tasks);
+	free(ids);
+
+	return failed;
+}
+
+// build the fft plan for frame windows of window_len samples, split into bands log spaced columns
+void init_fft_plan(int window_len, int bands, uint32_t sample_rate)
+{
+	fft_plan * fp = &g_fft_plan;
+
+	fp->p_size = 2;
+	while (fp->p_size < window_len)
+	{
+		fp->p_size *= 2;
+	}
+
+	fp->p_window_len = window_len;
+	fp->p_bands = bands;
+	fp->p_bit_reverse = malloc(fp->p_size * sizeof(int));
+	fp->p_cos = malloc(fp->p_size / 2 * sizeof(float));
+	fp->p_sin = malloc(fp->p_size / 2 * sizeof(float));
+	fp->p_window = malloc(window_len * sizeof(float));
+	fp->p_band_start = malloc((bands + 1) * sizeof(int));
+
+	int bits = 0;
+	while ((1 << bits) < fp->p_size)
+	{
+		bits++;
+	}
+
+	int i;
+	for (i = 0; i < fp->p_size; i++)
+	{
+		int reversed = 0;
+
+		int b;
+		for (b = 0; b < bits; b++)
+		{
+			reversed |= ((i >> b) & 1) << (bits - 1 - b);
+		}
+
+		fp->p_bit_reverse[i] = reversed;
+	}
+
+	for (i = 0; i < fp->p_size / 2; i++)
+	{
+		fp->p_cos[i] = cos(2 * M_PI * i / fp->p_size);
+		fp->p_sin[i] = -sin(2 * M_PI * i / fp->p_size);
+	}
+
+	// hann, a full scale sine then peaks at a quarter of the sum of the window
+	float window_sum = 0;
+
+	for (i = 0; i < window_len; i++)
+	{
+		fp->p_window[i] = window_len > 1 ? 0.5 - 0.5 * cos(2 * M_PI * i / (window_len - 1)) : 1;
+		window_sum += fp->p_window[i];
+	}
+
+	fp->p_scale = window_sum / 2;
+
+	// log spaced bands from SPECTRUM_MIN_HZ to nyquist, every band gets at least one bin of its own
+	// unless there are more bands than bins, then neighbouring bands share a bin and it is repeated
+	double max_hz = sample_rate / 2.0;
+	int bins = fp->p_size / 2;
+
+	for (i = 0; i <= bands; i++)
+	{
+		double hz = SPECTRUM_MIN_HZ * pow(max_hz / SPECTRUM_MIN_HZ, (double) i / bands);
+		fp->p_band_start[i] = (int) (hz * fp->p_size / sample_rate);
+
+		if (fp->p_band_start[i] > bins)
+		{
+			fp->p_band_start[i] = bins;
+		}
+	}
+
+	for (i = 1; i <= bands && bins - fp->p_band_start[0] >= bands; i++)
+	{
+		if (fp->p_band_start[i] <= fp->p_band_start[i - 1])
+		{
+			fp->p_band_start[i] = fp->p_band_start[i - 1] + 1;
+		}
+	}
+}
+
+// free the fft plan
+void deinit_fft_plan()
+{
+	free(g_fft_plan.p_bit_reverse);
+	free(g_fft_plan.p_cos);
+	free(g_fft_plan.p_sin);
+	free(g_fft_plan.p_window);
+	free(g_fft_plan.p_band_start);
+}
+
+// in place radix 2 fft of re and im, p_size values each
+void fft(const fft_plan * fp, float * re, float * im)
+{
+	int n = fp->p_size;
+
+	int i;
+	for (i = 0; i < n; i++)
+	{
+		int j = fp->p_bit_reverse[i];
+
+		if (j > i)
+		{
+			float t = re[i];
+			re[i] = re[j];
+			re[j] = t;
+
+			t = im[i];
+			im[i] = im[j];
+			im[j] = t;
+		}
+	}
+
+	int len;
+	for (len = 2; len <= n; len *= 2)
+	{
+		int half = len / 2;
+		int step = n / len;
+
+		int start;
+		for (start = 0; start < n; start += len)
+		{
+			int k;
+			for (k = 0; k < half; k++)
+			{
+				float w_re = fp->p_cos[k * step];
+				float w_im = fp->p_sin[k * step];
+
+				int a = start + k;
+				int b = a + half;
+
+				float t_re = re[b] * w_re - im[b] * w_im;
+				float t_im = re[b] * w_im + im[b] * w_re;
+
+				re[b] = re[a] - t_re;
+				im[b] = im[a] - t_im;
+				re[a] += t_re;
+				im[a] += t_im;
+			}
+		}
+	}
+}
+
+// the band levels of count samples of a window, 0 to 255, re and im hold p_size values each
+void spectrum_levels(const fft_plan * fp, window_buffer * wb, const char * window, uint32_t count, float * re, float * im, uint8_t * levels)
+{
+	// every channel mixed down, windowed and zero padded
+	uint32_t i;
+	for (i = 0; i < (uint32_t) fp->p_size; i++)
+	{
+		re[i] = 0;
+		im[i] = 0;
+	}
+
+	reserve_window_channels(wb, count);
+
+	int channel;
+	for (channel = 0; channel < g_wav_channels; channel++)
+	{
+		decode_channel(window, count, channel, wb->b_left);
+
+		for (i = 0; i < count; i++)
+		{
+			re[i] += wb->b_left[i];
+		}
+	}
+
+	for (i = 0; i < count; i++)
+	{
+		re[i] *= fp->p_window[i] / g_wav_channels;
+	}
+
+	fft(fp, re, im);
+
+	// the loudest bin of each band, in decibels below full scale, a band that shares its bin reads it again
+	int band;
+	for (band = 0; band < fp->p_bands; band++)
+	{
+		float peak = 0;
+		int end = fp->p_band_start[band + 1] > fp->p_band_start[band] ? fp->p_band_start[band + 1] : fp->p_band_start[band] + 1;
+
+		int bin;
+		for (bin = fp->p_band_start[band]; bin < end; bin++)
+		{
+			float mag = re[bin] * re[bin] + im[bin] * im[bin];
+			peak = mag > peak ? mag : peak;
+		}
+
+		float db = 10 * log10f(peak / (fp->p_scale * fp->p_scale) + 1e-12f);
+		float level = (db + SPECTRUM_RANGE_DB) / SPECTRUM_RANGE_DB;
+
+		levels[band] = level <= 0 ? 0 : (level >= 1 ? 255 : (uint8_t) (level * 255));
+	}
+}
+
+// spectrum thread, works out the band levels of a range of frames
+static void * spectrum_frames(void * param)
+{
+	spectrum_task * st = (spectrum_task *) param;
+	const fft_plan * fp = &g_fft_plan;
+
+	float * re = malloc(fp->p_size * sizeof(float));
+	float * im = malloc(fp->p_size * sizeof(float));
+	window_buffer wb;
+
+	init_window_buffer(&wb);
+
+	int64_t f;
+	for (f = st->t_first_frame; f < st->t_last_frame; f++)
+	{
+		uint64_t first = f * fp->p_window_len;
+		uint32_t count = fp->p_window_len;
+
+		if (first + count > st->t_samples)
+		{
+			count = st->t_samples - first;
+		}
+
+		const char * window = read_wav_window(&wb, first * g_wav_block_align, (size_t) count * g_wav_block_align);
+
+		if (window == NULL)
+		{
+			st->t_failed = 1;
+			break;
+		}
+
+		spectrum_levels(fp, &wb, window, count, re, im, st->t_levels + (size_t) (f - st->t_first_frame) * fp->p_bands);
+	}
+
+	free(re);
+	free(im);
+	deinit_window_buffer(&wb);
+
+	return NULL;
+}
+
+// draw the levels of one frame into frame, as bars or as a new spectrogram row
+void render_spectrum_frame(char * frame, const uint8_t * levels, int64_t frame_index, int col, int row, char color)
+{
+	// quiet to loud
+	static const char shades[] = " .:-=+*#%@";
+	static const char heat[] = { 0, 1, 3, 2, 6, 4, 5, 7 };
+
+	int c;
+	int r;
+
+	if (g_visual == VISUAL_SPECTRUM)
+	{
+		for (c = 0; c < col; c++)
+		{
+			int height = (levels[c] * row + 127) / 255;
+
+			for (r = 0; r < row; r++)
+			{
+				char * cell = frame + CH_BYTS * (c + col * r);
+
+				if (r >= row - height)
+				{
+					cell[0] = color;
+					cell[1] = '*';
+				}
+				else
+				{
+					cell[0] = 0;
+					cell[1] = ' ';
+				}
+			}
+		}
+
+		uint64_t random_state = frame_random_state(frame_index);
+
+		randomize_chars(frame, col * row, &random_state);
+
+		return;
+	}
+
+	// scroll the spectrogram up and shade the new bottom row
+	memmove(frame, frame + CH_BYTS * col, CH_BYTS * col * (row - 1));
+
+	char * bottom = frame + CH_BYTS * col * (row - 1);
+
+	for (c = 0; c < col; c++)
+	{
+		int shade = levels[c] * (int) (sizeof(shades) - 2) / 255;
+
+		bottom[CH_BYTS * c] = shade == 0 ? 0 : heat[levels[c] * 7 / 256 + 1];
+		bottom[CH_BYTS * c + 1] = shades[shade];
+	}
+}
+
+// convert fno frames of spectrum or spectrogram, the fft work is split into a range of frames per thread
+int convert_spectrum(nviz_writer * nviz, int col, int row, char color, int64_t fno, uint32_t sample_rate, uint32_t samples_per_frame, uint64_t samples)
+{
+	init_fft_plan(samples_per_frame, col, sample_rate);
+
+	int threads = thread_count(fno);
+
+	uint8_t * levels = malloc((size_t) fno * col);
+	spectrum_task * tasks = malloc(threads * sizeof(spectrum_task));
+	pthread_t * ids = malloc(threads * sizeof(pthread_t));
+
+	int t;
+	for (t = 0; t < threads; t++)
+	{
+		tasks[t].t_first_frame = (int64_t) fno * t / threads;
+		tasks[t].t_last_frame = (int64_t) fno * (t + 1) / threads;
+		tasks[t].t_samples = samples;
+		tasks[t].t_levels = levels + (size_t) tasks[t].t_first_frame * col;
+		tasks[t].t_failed = 0;
+
+		pthread_create(&ids[t], NULL, &spectrum_frames, &tasks[t]);
+	}
+
+	int failed = 0;
+
+	for (t = 0; t < threads; t++)
+	{
+		pthread_join(ids[t], NULL);
+
+		failed |= tasks[t].t_failed;
+	}
+
+	// drawing is cheap next to the fft, and the spectrogram scrolls, so it is done in order
+	char * frame = malloc(CH_BYTS * col * row);
+
+	int i;
+	for (i = 0; i < col * row; i++)
+	{
+		frame[CH_BYTS * i] = 0;
+		frame[CH_BYTS * i + 1] = ' ';
+	}
+
+	// a window that could not be read fails the whole conversion, nothing is written for it
+	int64_t f;
+	for (f = 0; f < fno && !failed; f++)
+	{
+		render_spectrum_frame(frame, levels + (size_t) f * col, f, col, row, color);
+
+		failed = nviz_write_frame(nviz, frame);
+	}
+
+	free(frame);
+	free(levels);
+	free(tasks);
+	free(ids);
+
+	deinit_fft_plan();
+
+	return failed;
+}
+
+// skip len bytes of a file that may not be seekable, returns 1 if it ended first
+int skip_bytes(FILE * file, uint64_t len)
+{
+	char skip[4096];
+
+	while (len > 0)
+	{
+		size_t n = fread(skip, 1, len < sizeof(skip) ? len : sizeof(skip), file);
+
+		if (n == 0)
+		{
+			return 1;
+		}
+
+		len -= n;
+	}
+
+	return 0;
+}
 
-int main(int argc, char * argv[])
+// convert samples to frames as they come in until the input ends, returns 1 if the frames could not be written
+// a frame is written as soon as its window has been read, so it is at most one window behind the input
+// when the input is a pipe and more than buffer_bytes pile up behind the window, whole windows are skipped to catch up
+int convert_stream(FILE * wav_file, nviz_writer * nviz, int col, int row, char color, uint32_t sample_rate, uint32_t samples_per_frame, size_t buffer_bytes, int64_t * fno)
 {
-	// seed random
-	srand(time(NULL));
+	size_t window_bytes = (size_t) samples_per_frame * g_wav_block_align;
+	size_t frame_bytes = CH_BYTS * col * row;
+	uint32_t count = g_measure == MEASURE_SAMPLE && g_visual == VISUAL_WAVE ? 1 : samples_per_frame;
+	char * frame = malloc(frame_bytes);
+	int failed = 0;
 
-	// check for the right number of arguments
-	if (argc != 7)
+	window_buffer wb;
+	wave_history wh;
+	float * re = NULL;
+	float * im = NULL;
+	uint8_t * levels = NULL;
+
+	init_window_buffer(&wb);
+
+	wb.b_size = window_bytes;
+	wb.b_data = malloc(window_bytes);
+
+	if (g_visual == VISUAL_WAVE)
 	{
-		fprintf(stderr, "ERROR - wrong number of arguments\n");
-		fprintf(stderr, "usage: %s in_file_path out_file_path columns rows frames_per_second color\n", argv[0]);
-		return 1;
+		init_wave_history(&wh, col, row);
 	}
+	else
+	{
+		init_fft_plan(samples_per_frame, col, sample_rate);
 
-	// make the wav file path
-	char wav_file_path[256];
-	sprintf(wav_file_path, argv[1]);
+		re = malloc(g_fft_plan.p_size * sizeof(float));
+		im = malloc(g_fft_plan.p_size * sizeof(float));
+		levels = malloc(col);
 
-	// make the nviz file path
-	char nviz_file_path[256];
-	sprintf(nviz_file_path, argv[2]);
+		int i;
+		for (i = 0; i < col * row; i++)
+		{
+			frame[CH_BYTS * i] = 0;
+			frame[CH_BYTS * i + 1] = ' ';
+		}
+	}
 
-	// input columns, rows, frames_per_second, and color
-	uint8_t col = atoi(argv[3]);
-	uint8_t row = atoi(argv[4]);
-	uint8_t fps = atoi(argv[5]);
-	char color = atoi(argv[6]);
+	// only a pipe or a socket can say how much is waiting in it
+	struct stat st;
+	int can_fall_behind = fstat(fileno(wav_file), &st) == 0 && (S_ISFIFO(st.st_mode) || S_ISSOCK(st.st_mode));
 
-	// declare and open the wav_file
-	FILE * wav_file = fopen(wav_file_path, "rb");
+	int64_t f;
+	for (f = 0; fread(wb.b_data, 1, window_bytes, wav_file) == window_bytes; f++)
+	{
+		int pending = 0;
 
-	// check that the file could be opened
-	if (wav_file == NULL)
+		// the newest complete window is drawn, the ones before it are dropped
+		while (can_fall_behind && ioctl(fileno(wav_file), FIONREAD, &pending) == 0 && (size_t) pending > buffer_bytes && (size_t) pending - buffer_bytes >= window_bytes)
+		{
+			if (fread(wb.b_data, 1, window_bytes, wav_file) != window_bytes)
+			{
+				break;
+			}
+
+			g_stream_dropped++;
+		}
+
+		if (g_visual == VISUAL_WAVE)
+		{
+			float lpercent;
+			float rpercent;
+			uint64_t random_state = frame_random_state(f);
+
+			measure_samples(&wb, wb.b_data, count, &lpercent, &rpercent);
+			push_wave_row(&wh, lpercent, rpercent, color);
+			assemble_wave_frame(&wh, frame);
+			randomize_chars(frame, col * row, &random_state);
+		}
+		else
+		{
+			spectrum_levels(&g_fft_plan, &wb, wb.b_data, count, re, im, levels);
+			render_spectrum_frame(frame, levels, f, col, row, color);
+		}
+
+		if (nviz_write_frame(nviz, frame))
+		{
+			failed = 1;
+			break;
+		}
+	}
+
+	*fno = f;
+
+	if (g_visual == VISUAL_WAVE)
 	{
-		fprintf(stderr, "ERROR - could not open %s\n", wav_file_path);
-		return 1;
+		deinit_wave_history(&wh);
+	}
+	else
+	{
+		free(re);
+		free(im);
+		free(levels);
+		deinit_fft_plan();
 	}
 
-	// calculate the file size
-	fseek(wav_file, 0, SEEK_END);
-	uint32_t file_size = ftell(wav_file);
-	fseek(wav_file, 0, SEEK_SET);
+	deinit_window_buffer(&wb);
+	free(frame);
+
+	return failed;
+}
+
+// read len bytes of a wav header, returns 1 if the file ended or could not be read first
+int read_header_bytes(FILE * wav_file, void * bytes, size_t len)
+{
+	return len > 0 && fread(bytes, len, 1, wav_file) != 1;
+}
 
+// read the header of a wav file up to the start of its data chunk and pick the decoder, returns 1 if it cannot be converted
+// a stream is read forward only, its size is not known and its data chunk goes on until it ends
+// RF64 and BW64 files keep the 64 bit sizes of a data chunk over 4 GB in a ds64 chunk before fmt 
+int read_wav_header(FILE * wav_file, const char * wav_file_path, int stream, off_t file_size, uint32_t * sample_rate, uint64_t * data_size)
+{
 	// check that wav_file contains minimum bytes for RIFF, fmt , and data
-	if (file_size < 44)
+	if (!stream && file_size < 44)
 	{
 		fprintf(stderr, "ERROR - %s does not contain enough bytes for RIFF, fmt , and data\n", wav_file_path);
 		return 1;
@@ -67,12 +1397,16 @@ int main(int argc, char * argv[])
 	uint32_t Format;
 
 	// read RIFF
-	fread(&ChunkID, 4, 1, wav_file);
-	fread(&ChunkSize, 4, 1, wav_file);
-	fread(&Format, 4, 1, wav_file);
+	if (read_header_bytes(wav_file, &ChunkID, 4) || read_header_bytes(wav_file, &ChunkSize, 4) || read_header_bytes(wav_file, &Format, 4))
+	{
+		fprintf(stderr, "ERROR - could not read the RIFF chunk of %s\n", wav_file_path);
+		return 1;
+	}
 
-	// check RIFF
-	if (ChunkID != 0x46464952)
+	// check RIFF, or its 64 bit forms RF64 and BW64
+	int rf64 = ChunkID == 0x34364652 || ChunkID == 0x34365742;
+
+	if (ChunkID != 0x46464952 && !rf64)
 	{
 		fprintf(stderr, "ERROR - RIFF FOURCC\n");
 		return 1;
@@ -93,6 +1427,41 @@ int main(int argc, char * argv[])
 	printf("Format\t\t\t\t0x%08x\t\t%d\n", Format, Format);
 	printf("\n");
 
+	// ds64
+	uint64_t ds64_data_size = 0;
+
+	if (rf64)
+	{
+		uint32_t ds64_id;
+		uint32_t ds64_size;
+		uint64_t ds64_riff_size;
+
+		if (read_header_bytes(wav_file, &ds64_id, 4) || read_header_bytes(wav_file, &ds64_size, 4))
+		{
+			fprintf(stderr, "ERROR - could not read the ds64 chunk of %s\n", wav_file_path);
+			return 1;
+		}
+
+		if (ds64_id != 0x34367364 || ds64_size < 16)
+		{
+			fprintf(stderr, "ERROR - ds64 FOURCC\n");
+			return 1;
+		}
+
+		if (read_header_bytes(wav_file, &ds64_riff_size, 8) || read_header_bytes(wav_file, &ds64_data_size, 8)
+			|| skip_bytes(wav_file, (uint64_t) ds64_size - 16 + (ds64_size & 1)))
+		{
+			fprintf(stderr, "ERROR - could not read the ds64 chunk of %s\n", wav_file_path);
+			return 1;
+		}
+
+		printf("ds64\n");
+		printf("\n");
+		printf("riffSize\t\t\t%llu\n", (unsigned long long) ds64_riff_size);
+		printf("dataSize\t\t\t%llu\n", (unsigned long long) ds64_data_size);
+		printf("\n");
+	}
+
 	// fmt 
 	uint32_t Subchunk1ID;
 	uint32_t Subchunk1Size;
@@ -104,22 +1473,44 @@ int main(int argc, char * argv[])
 	uint16_t BitsPerSample;
 
 	// read fmt 
-	fread(&Subchunk1ID, 4, 1, wav_file);
-	fread(&Subchunk1Size, 4, 1, wav_file);
-	fread(&AudioFormat, 2, 1, wav_file);
-	fread(&NumChannels, 2, 1, wav_file);
-	fread(&SampleRate, 4, 1, wav_file);
-	fread(&ByteRate, 4, 1, wav_file);
-	fread(&BlockAlign, 2, 1, wav_file);
-	fread(&BitsPerSample, 2, 1, wav_file);
+	if (read_header_bytes(wav_file, &Subchunk1ID, 4) || read_header_bytes(wav_file, &Subchunk1Size, 4)
+		|| read_header_bytes(wav_file, &AudioFormat, 2) || read_header_bytes(wav_file, &NumChannels, 2)
+		|| read_header_bytes(wav_file, &SampleRate, 4) || read_header_bytes(wav_file, &ByteRate, 4)
+		|| read_header_bytes(wav_file, &BlockAlign, 2) || read_header_bytes(wav_file, &BitsPerSample, 2))
+	{
+		fprintf(stderr, "ERROR - could not read the fmt  chunk of %s\n", wav_file_path);
+		return 1;
+	}
 
 	// check fmt 
-	if (Subchunk1ID != 0x20746d66)
+	if (Subchunk1ID != 0x20746d66 || Subchunk1Size < 16)
 	{
 		fprintf(stderr, "ERROR - fmt  FOURCC\n");
 		return 1;
 	}
 
+	// read the fmt  extension, WAVE_FORMAT_EXTENSIBLE keeps the real format in the first two bytes of its SubFormat guid
+	uint16_t SubFormat = AudioFormat;
+	unsigned char fmt_extension[64];
+	uint32_t fmt_extension_size = Subchunk1Size - 16;
+
+	if (fmt_extension_size > sizeof(fmt_extension))
+	{
+		fmt_extension_size = sizeof(fmt_extension);
+	}
+
+	if (read_header_bytes(wav_file, fmt_extension, fmt_extension_size)
+		|| skip_bytes(wav_file, (uint64_t) (Subchunk1Size - 16) - fmt_extension_size + (Subchunk1Size & 1)))
+	{
+		fprintf(stderr, "ERROR - could not read the fmt  extension of %s\n", wav_file_path);
+		return 1;
+	}
+
+	if (AudioFormat == WAVE_FORMAT_EXTENSIBLE && fmt_extension_size >= 10)
+	{
+		SubFormat = fmt_extension[8] | (fmt_extension[9] << 8);
+	}
+
 	// print fmt  chunk info
 	printf("fmt \n");
 	printf("\n");
@@ -131,8 +1522,22 @@ int main(int argc, char * argv[])
 	printf("ByteRate\t\t\t0x%08x\t\t%d\n", ByteRate, ByteRate);
 	printf("BlockAlign\t\t\t0x%8x\t\t%d\n", BlockAlign, BlockAlign);
 	printf("BitsPerSample\t\t\t0x%8x\t\t%d\n", BitsPerSample, BitsPerSample);
+
+	if (AudioFormat == WAVE_FORMAT_EXTENSIBLE)
+	{
+		printf("SubFormat\t\t\t0x%8x\t\t%d\n", SubFormat, SubFormat);
+	}
+
 	printf("\n");
 
+	// check that the samples can be decoded
+	if (init_wav_format(SubFormat, NumChannels, BitsPerSample, BlockAlign))
+	{
+		fprintf(stderr, "ERROR - this program works with 8, 16, 24 and 32 bit integer and 32 and 64 bit float .wav files\n");
+		fprintf(stderr, "        this file is format %d, %d channels of %d bit, %d bytes per block\n", SubFormat, NumChannels, BitsPerSample, BlockAlign);
+		return 1;
+	}
+
 	// data
 	uint32_t Subchunk2ID;
 	uint32_t Subchunk2Size;
@@ -161,23 +1566,65 @@ int main(int argc, char * argv[])
 		if (optional_chunk_id == 0x61746164)
 		{
 			Subchunk2ID = optional_chunk_id;
-			fread(&Subchunk2Size, 4, 1, wav_file);
+
+			if (read_header_bytes(wav_file, &Subchunk2Size, 4))
+			{
+				fprintf(stderr, "ERROR - could not read the data chunk size of %s\n", wav_file_path);
+				return 1;
+			}
+
 			break;
 		}
 		else if (optional_chunk_id != 0x00000000)
 		{
-			fread(&optional_chunk_size, 4, 1, wav_file);
+			if (read_header_bytes(wav_file, &optional_chunk_size, 4))
+			{
+				fprintf(stderr, "ERROR - could not read the optional chunk size of %s\n", wav_file_path);
+				return 1;
+			}
 
 			printf("optional_chunk_id\t\t0x%08x\t\t%d\n", optional_chunk_id, optional_chunk_id);
 			printf("optional_chunk_size\t\t0x%08x\t\t%d\n", optional_chunk_size, optional_chunk_size);
 			printf("\n");
 
-			fseek(wav_file, optional_chunk_size, SEEK_CUR);
+			// chunks are word aligned
+			if (skip_bytes(wav_file, (uint64_t) optional_chunk_size + (optional_chunk_size & 1)))
+			{
+				fprintf(stderr, "ERROR - end of file reached in optional chunk 0x%08x\n", optional_chunk_id);
+				return 1;
+			}
 		}
 	}
 
+	// print data chunk info
+	printf("data\n");
+	printf("\n");
+	printf("Subchunk2ID\t\t\t0x%08x\t\t%d\n", Subchunk2ID, Subchunk2ID);
+	printf("Subchunk2Size\t\t\t0x%08x\t\t%d\n", Subchunk2Size, Subchunk2Size);
+	printf("\n");
+
+	// a data chunk over 4 GB has 0xffffffff for its size, the real size is in ds64
+	// a plain RIFF file written past 4 GB that way has no ds64, its data goes on to the end of the file
+	*sample_rate = SampleRate;
+	*data_size = Subchunk2Size;
+
+	if (Subchunk2Size == 0xffffffff && rf64)
+	{
+		*data_size = ds64_data_size;
+	}
+	else if (Subchunk2Size == 0xffffffff && !stream)
+	{
+		*data_size = (file_size - ftello(wav_file)) / BlockAlign * BlockAlign;
+	}
+
+	// a stream is read until it ends, whatever size its data chunk claims
+	if (stream)
+	{
+		return 0;
+	}
+
 	// check that the audio information can be stored in the following bytes
-	if (Subchunk2Size % (NumChannels * BitsPerSample / 8) != 0)
+	if (*data_size % BlockAlign != 0)
 	{
 		fprintf(stderr, "ERROR - could not parse %s\n", wav_file_path);
 		fprintf(stderr, "        the number of bytes indicated by Subchunk2Size does not match the number of bytes indicated by NumChannels and BitsPerSample\n");
@@ -185,159 +1632,283 @@ int main(int argc, char * argv[])
 	}
 
 	// check that the file contains enough audio words
-	if (file_size - ftell(wav_file) < Subchunk2Size)	// *using ftell() here is a hack*
+	if ((uint64_t) (file_size - ftello(wav_file)) < *data_size)
 	{
 		fprintf(stderr, "ERROR - could not parse %s\n", wav_file_path);
 		fprintf(stderr, "        the number of bytes indicated by Subchunk2Size does not fit in the file\n");
 		return 1;
 	}
 
-	// check that the file is 44.1 kHz / 16 bit
-	if (SampleRate != 44100 || BitsPerSample != 16)
+	return 0;
+}
+
+// print the info of the nviz file that was made
+void print_nviz_info(int col, int row, int fps, int64_t fno)
+{
+	printf("nviz file info\n");
+	printf("\n");
+	printf("col\t\t\t\t%d\n", col);
+	printf("row\t\t\t\t%d\n", row);
+	printf("fps\t\t\t\t%d\n", fps);
+	printf("fno\t\t\t\t%lld\n", (long long) fno);
+	printf("seed\t\t\t\t%llu\n", (unsigned long long) g_seed);
+	printf("decoder\t\t\t\t%s\n", g_decode_name);
+	printf("kernel\t\t\t\t%s\n", g_measure == MEASURE_SAMPLE ? "none" : g_measure_kernel_name);
+}
+
+// main
+int main(int argc, char * argv[])
+{
+	// the seed defaults to the time, it is printed so that a run can be repeated with -s
+	g_seed = time(NULL);
+
+	// command line options
+	const char * kernel = "auto";
+	const char * raw_format = NULL;
+	int opt;
+	while ((opt = getopt(argc, argv, "m:k:v:j:s:r:b:z")) != -1)
+	{
+		switch (opt)
+		{
+			case 'm':
+				if (strcmp(optarg, "sample") == 0)
+				{
+					g_measure = MEASURE_SAMPLE;
+				}
+				else if (strcmp(optarg, "peak") == 0)
+				{
+					g_measure = MEASURE_PEAK;
+				}
+				else if (strcmp(optarg, "rms") == 0)
+				{
+					g_measure = MEASURE_RMS;
+				}
+				else
+				{
+					argc = 0;
+				}
+				break;
+			case 'k':
+				kernel = optarg;
+				break;
+			case 'v':
+				if (strcmp(optarg, "wave") == 0)
+				{
+					g_visual = VISUAL_WAVE;
+				}
+				else if (strcmp(optarg, "spectrum") == 0)
+				{
+					g_visual = VISUAL_SPECTRUM;
+				}
+				else if (strcmp(optarg, "spectrogram") == 0)
+				{
+					g_visual = VISUAL_SPECTROGRAM;
+				}
+				else
+				{
+					argc = 0;
+				}
+				break;
+			case 'j':
+				g_threads = atoi(optarg);
+				break;
+			case 's':
+				g_seed = strtoull(optarg, NULL, 10);
+				break;
+			case 'r':
+				raw_format = optarg;
+				break;
+			case 'b':
+				g_stream_buffer_ms = atoi(optarg);
+				break;
+			case 'z':
+				g_nviz_version = NVIZ_VERSION_DELTA;
+				break;
+			default:
+				argc = 0;
+				break;
+		}
+	}
+
+	// check for the right number of arguments
+	if (argc - optind != 6)
+	{
+		fprintf(stderr, "ERROR - wrong number of arguments\n");
+		fprintf(stderr, "usage: %s [-m sample|peak|rms] [-k auto|scalar|sse2|avx2] [-v wave|spectrum|spectrogram] [-j threads] [-s seed] [-r sample_rate:channels:format] [-b buffer_ms] [-z] in_file_path out_file_path columns rows frames_per_second color\n", argv[0]);
+		return 1;
+	}
+
+	if (init_measure_kernel(kernel))
 	{
-		fprintf(stderr, "ERROR - this program only works with 44100 Hz / 16 bit .wav files\n");
-		fprintf(stderr, "        this file is %d Hz / %d bit\n", SampleRate, BitsPerSample);
+		fprintf(stderr, "ERROR - the %s kernel is not available\n", kernel);
 		return 1;
 	}
 
-	// print data chunk info
-	printf("data\n");
-	printf("\n");
-	printf("Subchunk2ID\t\t\t0x%08x\t\t%d\n", Subchunk2ID, Subchunk2ID);
-	printf("Subchunk2Size\t\t\t0x%08x\t\t%d\n", Subchunk2Size, Subchunk2Size);
-	printf("\n");
+	argv += optind - 1;
 
-	// left and right sample values
-	int16_t l = 0;
-	int16_t r = 0;
+	// make the wav file path, - reads the samples from stdin as they come in
+	char wav_file_path[256];
+	sprintf(wav_file_path, argv[1]);
 
-	// variables for calculations/write out
-	float lpercent = 0;
-	float rpercent = 0;
+	// make the nviz file path, - writes the frames to stdout as they are made
+	char nviz_file_path[256];
+	sprintf(nviz_file_path, argv[2]);
 
-	int lamp = 0;
-	int ramp = 0;
+	// input columns, rows, frames_per_second, and color
+	uint8_t col = atoi(argv[3]);
+	uint8_t row = atoi(argv[4]);
+	uint8_t fps = atoi(argv[5]);
+	char color = atoi(argv[6]);
 
-	// nviz info
-	// col										// supplied by user, declared/defined above
-	// row										// supplied by user, declared/defined above
-	// fps										// supplied by user, declared/defined above
-	int16_t sec = ((Subchunk2Size / (BitsPerSample / 8)) / 2) / SampleRate;		// integer number of seconds
-	int32_t fno = fps * sec;							// maximum number of frames that fps goes evenly into
-	int32_t frame_count = 0;							// used to truncate remaining frames
+	// stdin or stdout make this a stream, it is converted a frame at a time and its length is not known until it ends
+	int stream = strcmp(wav_file_path, "-") == 0 || strcmp(nviz_file_path, "-") == 0;
+	int nviz_fd = -1;
 
-	// a buffer for a frame
-	char frame[CH_BYTS * (MAX_COL * MAX_ROW)];
-	memset(frame, 48, CH_BYTS * (MAX_COL * MAX_ROW));
+	// the frames take over stdout, so the info printed along the way goes to stderr
+	if (strcmp(nviz_file_path, "-") == 0)
+	{
+		nviz_fd = dup(STDOUT_FILENO);
+		dup2(STDERR_FILENO, STDOUT_FILENO);
+	}
 
-	// declare and open nviz_file
-	FILE * nviz_file = fopen(nviz_file_path, "wb");
+	// declare and open the wav_file
+	FILE * wav_file = strcmp(wav_file_path, "-") == 0 ? stdin : fopen(wav_file_path, "rb");
 
-	// write out the video info
-	fwrite(&col, 1, 1, nviz_file);
-	fwrite(&row, 1, 1, nviz_file);
-	fwrite(&fps, 1, 1, nviz_file);
-	fwrite(&sec, 2, 1, nviz_file);
+	// check that the file could be opened
+	if (wav_file == NULL)
+	{
+		fprintf(stderr, "ERROR - could not open %s\n", wav_file_path);
+		return 1;
+	}
 
-	// let user know data conversion has begun
-	printf("converting audio data...\n");
-	printf("\n");
+	// calculate the file size, a stream is read unbuffered instead so that nothing read ahead hides in stdio
+	off_t file_size = 0;
 
-	// input the audio data
-	for (uint32_t s = 0; s < (Subchunk2Size / (BitsPerSample / 8)) / 2; s++)
+	if (stream)
 	{
-		// input left and right sample values
-		fread(&l, 2, 1, wav_file);
-		fread(&r, 2, 1, wav_file);
+		setvbuf(wav_file, NULL, _IONBF, 0);
+	}
+	else
+	{
+		fseeko(wav_file, 0, SEEK_END);
+		file_size = ftello(wav_file);
+		fseeko(wav_file, 0, SEEK_SET);
+	}
+
+	uint32_t SampleRate;
+	uint64_t data_size;
+
+	if (raw_format != NULL)
+	{
+		// raw samples have no header, the whole file is the data chunk
+		unsigned int channels = 0;
+		char name[8];
 
-		// adjust for two's compliment
-		if ((uint16_t) l > 32767)
+		if (sscanf(raw_format, "%u:%u:%7s", &SampleRate, &channels, name) != 3 || channels > 0xffff || init_raw_format(name, channels))
 		{
-			l = (uint16_t) l - 65536;
+			fprintf(stderr, "ERROR - -r takes sample_rate:channels:format, the format is one of u8, s16, s24, s32, f32 or f64\n");
+			return 1;
 		}
 
-		if ((uint16_t) r > 32767)
+		data_size = file_size - file_size % g_wav_block_align;
+	}
+	else if (read_wav_header(wav_file, wav_file_path, stream, file_size, &SampleRate, &data_size))
+	{
+		return 1;
+	}
+
+	// check that a frame covers at least one sample
+	if (fps == 0 || SampleRate < fps)
+	{
+		fprintf(stderr, "ERROR - frames_per_second must be between 1 and the %d Hz sample rate\n", SampleRate);
+		return 1;
+	}
+
+	// each frame covers a window of SampleRate / fps samples
+	uint32_t samples_per_frame = SampleRate / fps;
+
+	if (stream)
+	{
+		if (nviz_fd < 0)
 		{
-			r = (uint16_t) r - 65536;
+			nviz_fd = open(nviz_file_path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
 		}
 
-		// write out the waveform
-		if (s % (SampleRate / fps) == 0)
+		if (nviz_fd < 0)
 		{
-			// this truncates the frames from the last partial second
-			if (frame_count < fno)
-			{
-				// shift each row up
-				for (int rw = 0; rw < row - 1; rw++)
-				{
-					for (int cl = 0; cl < col; cl++)
-					{
-						frame[2 * (cl + col * rw)]     = frame[2 * (cl + col * (rw + 1))];
-						frame[2 * (cl + col * rw) + 1] = frame[2 * (cl + col * (rw + 1)) + 1];
-						if (frame[2 * (cl + col * rw) + 1] != ' ')
-						{
-							frame[2 * (cl + col * rw) + 1] = 32 + 94 * (float) rand() / (float) RAND_MAX;
-						}
-					}
-				}
-
-				// calculate the left amplitude
-				lpercent = (float) sqrt(l * l) / 32768.0;
-				lamp = (int) (col / 2 * lpercent);
+			fprintf(stderr, "ERROR - could not open %s\n", nviz_file_path);
+			return 1;
+		}
 
-				// calculate the right amplitude
-				rpercent = (float) sqrt(r * r) / 32768.0;
-				ramp = (int) (col / 2 * rpercent);
+		// a negative buffer never skips, for files piped in faster than real time
+		size_t buffer_bytes = g_stream_buffer_ms < 0 ? SIZE_MAX : (size_t) SampleRate * g_stream_buffer_ms / 1000 * g_wav_block_align;
+		int64_t fno = 0;
 
-				// add new sample info on the bottom row
-				// left channel
-				for (int la = 0; la < col / 2 - lamp; la++)
-				{
-					int cl = la;
-					frame[2 * (cl + col * (row - 1))]     = 0;
-					frame[2 * (cl + col * (row - 1)) + 1] = ' ';
-				}
-				for (int la = 0; la < lamp; la++)
-				{
-					int cl = (col / 2 - lamp) + la;
-					frame[2 * (cl + col * (row - 1))] = color;
-					frame[2 * (cl + col * (row - 1)) + 1] = 32 + 94 * (float) rand() / (float) RAND_MAX;
-				}
-				// right channel
-				for (int ra = 0; ra < ramp; ra++)
-				{
-					int cl = (col / 2) + ra;
-					frame[2 * (cl + col * (row - 1))] = color;
-					frame[2 * (cl + col * (row - 1)) + 1] = 32 + 94 * (float) rand() / (float) RAND_MAX;
-				}
-				for (int ra = 0; ra < col / 2 - ramp; ra++)
-				{
-					int cl = (col / 2 + ramp) + ra;
-					frame[2 * (cl + col * (row - 1))]     = 0;
-					frame[2 * (cl + col * (row - 1)) + 1] = ' ';
-				}
+		printf("streaming audio data...\n");
+		printf("\n");
 
-				// write out the new frame
-				fwrite(frame, 1, CH_BYTS * col * row, nviz_file);
+		// 0 frames, the frames go on until the input ends, and each one is written straight out
+		nviz_writer nviz;
 
-				frame_count++;
-			}
+		if (nviz_create_fd(&nviz, nviz_fd, g_nviz_version, col, row, fps, 0, 0) || convert_stream(wav_file, &nviz, col, row, color, SampleRate, samples_per_frame, buffer_bytes, &fno) || nviz_finish(&nviz))
+		{
+			fprintf(stderr, "ERROR - could not convert %s to %s\n", wav_file_path, nviz_file_path);
+			return 1;
 		}
+
+		fclose(wav_file);
+
+		print_nviz_info(col, row, fps, fno);
+		printf("dropped\t\t\t\t%ld\n", (long) g_stream_dropped);
+		printf("\n");
+
+		return 0;
+	}
+
+	// the data chunk is read from here on by the wav reader
+	if (init_wav_reader(wav_file_path, ftello(wav_file), data_size))
+	{
+		fprintf(stderr, "ERROR - could not open %s\n", wav_file_path);
+		return 1;
+	}
+
+	// nviz info
+	// col										// supplied by user, declared/defined above
+	// row										// supplied by user, declared/defined above
+	// fps										// supplied by user, declared/defined above
+	uint64_t samples = data_size / g_wav_block_align;
+	int64_t fno = samples / samples_per_frame;					// every whole window, the frame count is 64 bit so nothing is truncated to whole seconds
+
+	// open the nviz file and write out the video info
+	nviz_writer nviz;
+
+	if (nviz_create(&nviz, nviz_file_path, g_nviz_version, col, row, fps, fno, NVIZ_WRITE_BUFFER))
+	{
+		fprintf(stderr, "ERROR - could not open %s\n", nviz_file_path);
+		return 1;
 	}
 
-	// close nviz_file
-	fclose(nviz_file);
+	// let user know data conversion has begun
+	printf("converting audio data...\n");
+	printf("\n");
+
+	int failed = g_visual != VISUAL_WAVE
+		? convert_spectrum(&nviz, col, row, color, fno, SampleRate, samples_per_frame, samples)
+		: convert_wave(&nviz, col, row, color, fno, samples_per_frame, samples);
+
+	// finish nviz_file, the buffered frames go out
+	if (nviz_finish(&nviz) || failed)
+	{
+		fprintf(stderr, "ERROR - could not convert %s to %s\n", wav_file_path, nviz_file_path);
+		return 1;
+	}
 
 	// close wave_file
+	deinit_wav_reader();
 	fclose(wav_file);
 
 	// print nviz info
-	printf("nviz file info\n");
-	printf("\n");
-	printf("col\t\t\t\t%d\n", col);
-	printf("row\t\t\t\t%d\n", row);
-	printf("fps\t\t\t\t%d\n", fps);
-	printf("fno\t\t\t\t%d\n", fno);
+	print_nviz_info(col, row, fps, fno);
 	printf("\n");
 
 	return 0;